@@ -3,8 +3,8 @@
  * provides stock blade behavior
  *   - animate blade ignition
  *   - animate blade extinguish
- *   - animate blade clash
- *   - animate flicker effect for kylo ren legacy blade
+ *   - animate blade clash (as an overlay, see render.h)
+ *   - animate flicker effect for kylo ren legacy blade (see stock_flicker_start())
  *   - set stock blade color based on command received from hilt
  *   - set blade state to ON after ignition animation completes
  *   - set blade state to OFF after extinguish animation completes
@@ -17,11 +17,146 @@
 #include "serial.h"
 #include "device_config.h"
 #include "blade_state.h"
+#include "fixed.h"
+#include "render.h"
+#include "dmode_handler.h"
+
+// stock flicker brightness lookup tables, indexed by flicker level
+//   levels  0-15: DATA_CMD_REDFLICKER_1, nearly off to mid brightness
+//   levels 16-31: DATA_CMD_REDFLICKER_2, mid brightness to full brightness
+//
+// the blade jumps to the peak brightness when the command arrives, then fades to the settle
+// brightness over STOCK_FLICKER_DECAY_TIME milliseconds. the peak is not ramped to: that would only
+// delay the flash, and the fade already smooths the step down. values are raw segment brightness (0-255)
+// and match the percentages used by the original two-step flicker: (level + 1) * 3.125% peak,
+// (level - 5) * 3.125% settle for _FLICKER_1, (level + 1) * 3.125% and (level - 6) * 3.125% for _FLICKER_2
+const uint8_t stock_flicker_peak[STOCK_FLICKER_LEVELS] = {
+    7,  15,  22,  30,  38,  45,  53,  63,  71,  79,  86,  94, 102, 109, 117, 127,
+  135, 142, 150, 158, 165, 173, 181, 191, 198, 206, 214, 221, 229, 237, 244, 255
+};
+const uint8_t stock_flicker_settle[STOCK_FLICKER_LEVELS] = {
+    0,   0,   0,   0,   0,   0,   7,  15,  22,  30,  38,  45,  53,  63,  71,  79,
+   79,  86,  94, 102, 109, 117, 127, 135, 142, 150, 158, 165, 173, 181, 191, 198
+};
+
+// the current stock flicker level and the time it was received
+uint8_t stock_flicker_level = 0;
+uint32_t stock_flicker_time = 0;
+
+void stock_flicker_start(uint8_t level) {
+  uint8_t i;
+
+  stock_flicker_level = level & (STOCK_FLICKER_LEVELS - 1);
+  stock_flicker_time = millis();
+
+  // apply the peak right away rather than waiting on the next pass through animate_handler()
+  for (i=0;i<BLADE_SEGMENTS;i++) {
+    segment_brightness[i] = stock_flicker_peak[stock_flicker_level];
+  }
+  segment_dirty = SEGMENT_DIRTY_ALL;
+  blade.state = BLADE_STATE_STOCK_FLICKER;
+}
+
+// express an extinguish delay in milliseconds as ANIMATE_DELAY_UNITs
+#define ANIMATE_DELAY(ms) ((ms) / ANIMATE_DELAY_UNIT)
+
+// stock ignition; segments come on one after another, each taking 2 steps to reach full brightness.
+// keyframes are ANIMATE_STEP_TIME apart and hold the max segment brightness (0-255) of each segment
+const uint8_t ignite_keyframes[][BLADE_SEGMENTS] = {
+  {127,   0,   0,   0},
+  {255, 127,   0,   0},
+  {255, 255, 127,   0},
+  {255, 255, 255, 255}
+};
+
+// stock extinguish; segments shut off from the tip down, each taking 3 steps to go dark. keyframes are
+// ANIMATE_STEP_TIME apart and hold the max segment brightness (0-255) of each segment
+const uint8_t extinguish_keyframes[][BLADE_SEGMENTS] = {
+  {255, 255, 255,  51},
+  {255, 255, 168,  84},
+  {255, 168,  84,   0},
+  {168,  84,   0,   0},
+  { 84,   0,   0,   0},
+  {  0,   0,   0,   0}
+};
+
+// different kyber crystals and legacy sabers begin their shutdown animation at different times after
+// the switch is turned off, and some skip the first steps of the animation. these delays align the
+// extinguish animation with the timing of the stock blade. indexed by savi (0) or legacy (1), then color
+const struct extinguish_timing_struct extinguish_timing[2][STOCK_BLADE_COLORS_PER_TABLE] = {
+  { // Savi's Workshop
+    {ANIMATE_DELAY(340), 0},  //  0: white
+    {ANIMATE_DELAY(850), 0},  //  1: red
+    {0,                  2},  //  2: orange; skip two steps and go right to shutting off segment 4
+    {0,                  2},  //  3: yellow
+    {ANIMATE_DELAY(170), 0},  //  4: green
+    {ANIMATE_DELAY(255), 0},  //  5: blue
+    {ANIMATE_DELAY(255), 0},  //  6: cyan
+    {ANIMATE_DELAY(510), 0},  //  7: purple
+    {ANIMATE_DELAY(850), 0},  //  8: dark purple
+    {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}
+  },
+  { // Legacy
+    {0,                  1},  //  0: temple guard; skip a step to align timing of power off with stock blade
+    {ANIMATE_DELAY(765), 0},  //  1: kylo ren
+    {ANIMATE_DELAY(510), 0},  //  2: rey, rey reforge, ahsoka (clone wars)
+    {ANIMATE_DELAY(680), 0},  //  3: mace windu
+    {ANIMATE_DELAY(595), 0},  //  4: ventress
+    {ANIMATE_DELAY(170), 0},  //  5: ahsoka (post clone wars)
+    {ANIMATE_DELAY(170), 0},  //  6: luke
+    {ANIMATE_DELAY(595), 0},  //  7: vader
+    {ANIMATE_DELAY(680), 0},  //  8: maul
+    {ANIMATE_DELAY(510), 0},  //  9: obi-wan, ben solo
+    {ANIMATE_DELAY(225), 0},  // 10: baylan skoll/ shin hati
+    {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}
+  }
+};
+
+// set max_segment_brightness to where the animation described by keyframes, spaced ANIMATE_STEP_TIME
+// apart, is at time t, interpolating linearly between keyframes. returns 1 once t has reached the last
+// keyframe, otherwise 0
+static uint8_t keyframe_apply(const uint8_t (*keyframes)[BLADE_SEGMENTS], uint8_t len, uint16_t t) {
+  uint32_t steps;
+  uint8_t i, n, from, to, frac, level;
+
+  // how many keyframes have passed, in Q8.8; the low byte is how far along we are toward the next one
+  steps = ((uint32_t)t * ANIMATE_STEP_RECIP) >> 8;
+  n = len - 1;
+  frac = 0;
+  if (steps < ((uint32_t)n << 8)) {
+    n = steps >> 8;
+    frac = steps & 0xFF;
+  }
+
+  for (i=0;i<BLADE_SEGMENTS;i++) {
+    from = keyframes[n][i];
+    to = keyframes[n + (frac != 0)][i];
+    if (to >= from) {
+      level = from + (uint8_t)(((uint16_t)(to - from) * frac) >> 8);
+    } else {
+      level = from - (uint8_t)(((uint16_t)(from - to) * frac) >> 8);
+    }
+
+    // only flag segments that actually changed
+    if (max_segment_brightness[i] != level) {
+      max_segment_brightness[i] = level;
+      segment_dirty |= (1 << i);
+    }
+  }
+
+  // animation is complete once the last keyframe is reached
+  return (n == len - 1);
+}
 
 // manages changes in the blade display during stock animation effects (ignition, extinguish, clash)
+//
+// step 0 of each state prepares the blade and records the start time, step 1 plays the animation
+// until it's complete
 void animate_handler(void) {
-  static uint32_t next_event_time = 0;
+  static uint32_t start_time = 0;
   uint8_t state, state_step;
+  uint8_t i, peak, settle, brightness;
+  uint32_t elapsed;
 
   // determine blade state
   state = blade.state & 0xF0;
@@ -32,255 +167,101 @@ void animate_handler(void) {
     // determine current step of animation
     state_step = blade.state & 0x0F;
 
+    // milliseconds since the animation started; capped so it can be treated as a 16-bit value
+    elapsed = millis() - start_time;
+    if (elapsed > 0xFFFF) {
+      elapsed = 0xFFFF;
+    }
+
     // determine which animation operation is being performed
     switch (state) {
 
       // the blade is in a clash state (blade has hit against something and flashes)
       case BLADE_STATE_CLASH:
         if (state_step == 0) {
-          mem_blade(MEM_BLADE_BACKUP);      // backup blade state
-          blade.color_state += 0x10;        // record we're currently in a CLASH state
-          set_blade_color();                // set clash color
-          set_blade_brightness(100);        // set blade brightness to 100%
-          set_max_blade_brightness(100);    // set max blade brightness to 100%
-          next_event_time = millis() + 40;  // end clash after 40ms
+          // flash the clash color over the blade at full brightness
+          overlay_start(dmode_desc.clash_color, ANIMATE_CLASH_TIME, ANIMATE_CLASH_SETTLE_TIME);
+          start_time = millis();
+          elapsed = 0;
           blade.state++;                    // increment blade state counter
         }
-        else if (millis() > next_event_time) {
-          mem_blade(MEM_BLADE_RESTORE);     // restore blade state
-          blade.state = BLADE_STATE_ON;
+        if (elapsed >= ANIMATE_CLASH_TIME) {
+          blade.state = BLADE_STATE_ON;     // the overlay fades out on its own
         }
         break;
 
       // the blade is igniting; all legacy hilts and crystal colors have the same power-on timing
       case BLADE_STATE_POWER_ON:
-        if (millis() > next_event_time) {
-          next_event_time = millis() + 85;        // delay this many milliseconds until next step
-          switch (state_step) {
-            case 0:
-              set_blade_brightness(100);          // default blade brightness to 100%; dmode_handler() may change this later
-              set_max_blade_brightness(0);        // set max brightness to 0; effectively turning the blade off
-              blade_power_on();                   // enable the blade's LDO
-              set_max_segment_brightness(0, 50);  // start turning segment 1 on
-              break;
-
-            case 1:
-              set_max_segment_brightness(0, 100); // turning segment 1 on
-              set_max_segment_brightness(1, 50);  // start turning segment 2 on
-              break;
-
-            case 2:
-              set_max_segment_brightness(1, 100); // turning segment 2 on
-              set_max_segment_brightness(2, 50);  // start turning segment 3 on
-              break;
-
-            case 3:
-              set_max_segment_brightness(2, 100); // turning segment 3 on
-              set_max_segment_brightness(3, 100); // turning segment 4 on
-              blade.state = BLADE_STATE_ON;       // blade is fully on
-              break;
-
-            default:
-              break;
-          }
+        if (state_step == 0) {
+          set_blade_brightness(100);        // default blade brightness to 100%; dmode_handler() may change this later
+          set_max_blade_brightness(0);      // set max brightness to 0; effectively turning the blade off
+          blade_power_on();                 // enable the blade's LDO
+          start_time = millis();
+          elapsed = 0;
           blade.state++;
         }
+        if (keyframe_apply(ignite_keyframes, sizeof(ignite_keyframes) / sizeof(ignite_keyframes[0]), elapsed)) {
+          blade.state = BLADE_STATE_ON;     // blade is fully on
+        }
         break;
 
       // blade is being extinguished
       //
-      // different kyber crystals and legacy sabers begin their shutdown animation at different times after
-      // the switch is turned off. step 0 in the power off animation is setting a delay before
-      // power-off to align the animation timing with the stock blade.
-      //
-      // the stock blade also has different power-off animations (2 and 3-step fade-downs for segments)
-      // this code also adds time to align this code's single power-off animation timing with the different
-      // power-off animations of the stock blade
+      // the blade is held on for a delay that depends on the color, then the extinguish keyframes
+      // are played, possibly starting part way through. see extinguish_timing[]
       case BLADE_STATE_POWER_OFF:
-        if (millis() > next_event_time) {
-          next_event_time = millis() + 85;  // default delay until next step in ms
-          switch (state_step) {
-
-            case 0: // Set Power Off Animation Delay
-
-              // blade is in a legacy hilt
-              if ((blade.color_state >> 4) == STOCK_BLADE_COLOR_TABLE_LEGACY) {
-                switch (blade.color_state & 0x0F) {
-                  case 0: // temple guard
-                    blade.state++;      // skip a step to save 85ms and align timing of power off with stock blade performance
-                    next_event_time = 0;
-                    break;
-
-                  case 5: // ahsoka (post clone wars)
-                  case 6: // luke
-                    next_event_time += 85;
-                    break;
-
-                  case 10: // baylan skoll/ shin hati
-                    next_event_time += 140;
-                    break;
-
-                  case 9: // obi-wan, ben solo
-                  case 2: // rey, rey reforge, ahsoka (clone wars)
-                    next_event_time += 425;
-                    break;
-
-                  case 4: // ventress
-                  case 7: // vader
-                    next_event_time += 510;
-                    break;
-
-                  case 3: // mace windu
-                  case 8: // maul
-                    next_event_time += 595;
-                    break;
-
-                  case 1: // kylo ren
-                    next_event_time += 680;
-                    break;
-
-                  default:
-                    next_event_time = 0;
-                    break;
-                }
-
-              // blade is in a Savi's Workshop hilt
-              } else {
-                switch (blade.color_state & 0x0F) {
-                  case 2: // orange
-                  case 3: // yellow
-                    next_event_time = 0;
-                    blade.state += 2;       // mimic stock blade, which skips two steps and goes right to shutting off segment 4
-                    break;
-
-                  case 5: // blue
-                  case 6: // cyan
-                    next_event_time += 85;  // extra delay to align end of power off with time a stock blade takes
-              
-                  case 4: // green
-                    next_event_time += 85;  // cases 5 & 6 follow through to here, doubling their delay time
-                    break;
-
-                  case 7: // purple
-                    next_event_time += 170; // extra delay to align end of power off with time a stock blade takes
-              
-                  case 0: // white
-                    next_event_time += 255; // case 7 follows through to here
-                    break;
-
-                  case 1: // red
-                  case 8: // dark purple
-                    next_event_time += 765;
-                    break;
-
-                  default:
-                    next_event_time = 0;
-                    break;
-                }
-              }
-              break;
-
-            case 1:
-              set_max_segment_brightness(3, 66);  // start shutdown of segment 4; this entire process will take ~425ms
-              set_max_segment_brightness(3, 20);
-              break;
-
-            case 2:
-              set_max_segment_brightness(3, 33);
-              set_max_segment_brightness(2, 66);  // start shutdown of segment 3
-              break;
-
-            case 3:
-              set_max_segment_brightness(3, 0);   // shut off segment 4
-              set_max_segment_brightness(2, 33);
-              set_max_segment_brightness(1, 66);  // start shutdown of segment 2
-              break;
-
-            case 4:
-              set_max_segment_brightness(2, 0);   // shut off segment 3
-              set_max_segment_brightness(1, 33);
-              set_max_segment_brightness(0, 66);  // start shutdown of segment 1
-              break;
-
-            case 5:
-              set_max_segment_brightness(1, 0);   // shut off segment 2
-              set_max_segment_brightness(0, 33);
-              break;
-
-            case 6:
-              set_max_segment_brightness(0, 0);   // shut off segment 1
-              blade_power_off();                  // shut off LDO that powers RGB LEDs
-              blade.state = BLADE_STATE_OFF;      // set blade state to off
-              break;
-
-            default:
-              break;
-          }
-          if ((blade.state & 0xF0) != BLADE_STATE_OFF) {
-            blade.state++;
+        if (state_step == 0) {
+          start_time = millis();
+          elapsed = 0;
+          blade.state++;
+        }
+        if (elapsed >= (uint16_t)dmode_desc.extinguish->delay * ANIMATE_DELAY_UNIT) {
+          elapsed += (uint16_t)dmode_desc.extinguish->start * ANIMATE_STEP_TIME - (uint16_t)dmode_desc.extinguish->delay * ANIMATE_DELAY_UNIT;
+          if (keyframe_apply(extinguish_keyframes, sizeof(extinguish_keyframes) / sizeof(extinguish_keyframes[0]), elapsed)) {
+            blade_power_off();              // shut off LDO that powers RGB LEDs
+            blade.state = BLADE_STATE_OFF;  // set blade state to off
           }
         }
         break;
 
       // command sent by Kylo Ren legacy lightsaber that causes the blade to flicker
+      //
+      // the flicker level is applied by stock_flicker_start() the moment the command arrives; all
+      // that's left to do here is fade the blade from the peak down to the settle brightness
       case BLADE_STATE_STOCK_FLICKER:
+        elapsed = millis() - stock_flicker_time;
+        peak = stock_flicker_peak[stock_flicker_level];
+        settle = stock_flicker_settle[stock_flicker_level];
 
-        // There are two flicker commands. 
-        //   _FLICKER_1 = 0-50% brightness
-        //   _FLICKER_2 = 53-100% brightness
-        // 
-        // Flicker is two-steps. 
-        //   First step sets brightness for 40ms 
-        //   Second step drops brightness and it stays there until next command           
-        //
-        // This is not a perfect replication of the stock blade behavior, but
-        // it's close enough.
-
-        // first flicker step
-        if ((state_step & 1) == 0) {
-
-          // _FLICKER_1
-          if (state_step < 4) {
-            set_blade_brightness((uint8_t)((float)(blade.color_state + 1) * 3.125));
-
-          // _FLICKER_2
-          } else {
-            set_blade_brightness((uint8_t)((float)(blade.color_state + 17) * 3.125));
-          }
-
-          // increment blade state so code knows we're on step 2
-          blade.state++;
-          next_event_time = millis() + 40;
-
-        // second flicker step
-        } else if (millis() > next_event_time) {
-
-          // _FLICKER_1
-          if (state_step < 4) {
-            if (blade.color_state < 5) {
-              set_blade_brightness(0);
-            } else {
-              set_blade_brightness((uint8_t)((float)(blade.color_state - 5) * 3.125));
-            }
+        if (elapsed >= STOCK_FLICKER_DECAY_TIME) {
+          brightness = settle;
+          blade.state = BLADE_STATE_ON;
 
-          // _FLICKER_2
-          } else {
-            set_blade_brightness((uint8_t)((float)(blade.color_state + 10) * 3.125));
-          }
+        // linear fade; (elapsed * STOCK_FLICKER_DECAY_RECIP) >> 5 is how far along the fade is, out of 256
+        } else {
+          brightness = peak - (uint8_t)(((uint16_t)(peak - settle) * (uint8_t)(((uint16_t)elapsed * STOCK_FLICKER_DECAY_RECIP) >> 5)) >> 8);
+        }
 
-          // reset blade (?)
-          //blade.color_state = STOCK_BLADE_COLOR_RED;
-          blade.state = BLADE_STATE_ON;
+        for (i=0;i<BLADE_SEGMENTS;i++) {
+          segment_brightness[i] = brightness;
         }
+        segment_dirty = SEGMENT_DIRTY_ALL;
         break;
     }
   }
 }
 
 void true_segment_brightness_handler(void) {
-  uint8_t i;
+  uint8_t i, level;
 
   for(i=0;i<BLADE_SEGMENTS;i++) {
-    true_segment_brightness[i] = (uint8_t)(((float)max_segment_brightness[i]/255) * segment_brightness[i]);
+    if (segment_dirty & (1 << i)) {
+      level = mul8_div255(max_segment_brightness[i], segment_brightness[i]);
+      if (overlay_level != 0) {
+        level += mul8_div255(255 - level, overlay_level);
+      }
+      true_segment_brightness[i] = level;
+    }
   }
+  segment_dirty = 0;
 }
@@ -10,6 +10,8 @@
 #include "serial.h"
 #include "device_config.h"
 #include "blade_state.h"
+#include "fixed.h"
+#include "hsv.h"
 #include "data.h"
 
 // initialization of global variables
@@ -17,7 +19,7 @@
 
 struct blade_state_struct blade = {0, 0, 0, 0, 0};
 uint8_t state_loaded_from_eeprom = 0;
-volatile uint8_t segment_color[BLADE_SEGMENTS][RGB_SIZE] = {
+uint8_t segment_color[BLADE_SEGMENTS][RGB_SIZE] = {
   { 255,   0,   0},
   {   0, 255,   0},
   {   0,   0, 255},
@@ -25,10 +27,11 @@ volatile uint8_t segment_color[BLADE_SEGMENTS][RGB_SIZE] = {
 };
 uint8_t segment_brightness[BLADE_SEGMENTS] = { 0, 0, 0, 0 };
 uint8_t max_segment_brightness[BLADE_SEGMENTS] = { 0, 0, 0, 0 };
+uint8_t segment_dirty = SEGMENT_DIRTY_ALL;
 volatile uint8_t true_segment_brightness[BLADE_SEGMENTS];
-uint8_t stock_blade_colors[STOCK_BLADE_COLOR_LEN][RGB_SIZE] = {
+const uint8_t stock_blade_colors[STOCK_BLADE_COLOR_LEN][RGB_SIZE] = {
   //  RED, GRN, BLU
-  { 112, 112, 112 },  //  0:STOCK_BLADE_COLOR_WHITE
+  { STOCK_BLADE_WHITE_RED, STOCK_BLADE_WHITE_GRN, STOCK_BLADE_WHITE_BLU },  //  0:STOCK_BLADE_COLOR_WHITE
   { 255,   0,   0 },  //  1:STOCK_BLADE_COLOR_RED
   { 255, 102,   0 },  //  2:STOCK_BLADE_COLOR_ORANGE
   { 152, 152,   0 },  //  3:STOCK_BLADE_COLOR_YELLOW
@@ -42,7 +45,7 @@ uint8_t stock_blade_colors[STOCK_BLADE_COLOR_LEN][RGB_SIZE] = {
   { 255, 255,   0 },  // 11:STOCK_BLADE_COLOR_FLASH_YELLOW
   { 255,  64,   0 }   // 12:STOCK_BLADE_COLOR_FLASH_ORANGE
 };
-uint8_t stock_blade_color_table_lookup[STOCK_BLADE_COLOR_TABLES][STOCK_BLADE_COLORS_PER_TABLE] = {
+const uint8_t stock_blade_color_table_lookup[STOCK_BLADE_COLOR_TABLES][STOCK_BLADE_COLORS_PER_TABLE] = {
   {  // Savi's Workship Lightsabers Colors
     STOCK_BLADE_COLOR_WHITE,
     STOCK_BLADE_COLOR_RED,
@@ -121,7 +124,7 @@ uint8_t stock_blade_color_table_lookup[STOCK_BLADE_COLOR_TABLES][STOCK_BLADE_COL
 // see blade_state.h for their purpose
 void set_custom_segment_color(uint8_t segment, uint8_t red, uint8_t green, uint8_t blue) {
   //segment_color[segment][RED_IDX] = red;
-  segment_color[segment][RED_IDX] = (uint8_t)((float)red * RED_ADJUST);
+  segment_color[segment][RED_IDX] = q16_mul8(red, RED_ADJUST);
   segment_color[segment][GRN_IDX] = green;
   segment_color[segment][BLU_IDX] = blue;
 }
@@ -196,41 +199,39 @@ void rotate_segment_color(uint8_t direction) {
   }
 }
 
-void set_segment_color_by_wheel(uint8_t segment, uint8_t wheel_value) {
-  if (wheel_value < 85 ) {
-    set_custom_segment_color(segment, ~(wheel_value * 3), (wheel_value * 3), 0);
-  } else if (wheel_value < 170) {
-    wheel_value -= 85;
-    set_custom_segment_color(segment, 0, ~(wheel_value * 3), (wheel_value * 3));
-  } else {
-    wheel_value -= 170;
-    set_custom_segment_color(segment, (wheel_value * 3), 0, ~(wheel_value * 3));
-  }
+void set_segment_color_hsv(uint8_t segment, uint16_t hue, uint8_t sat, uint8_t val) {
+  uint8_t rgb[RGB_SIZE];
+
+  hsv_to_rgb(hue, sat, val, rgb);
+  set_custom_segment_color(segment, rgb[RED_IDX], rgb[GRN_IDX], rgb[BLU_IDX]);
 }
 
-void set_color_by_wheel(uint8_t color) {
+void set_blade_color_hsv(uint16_t hue, uint8_t sat, uint8_t val) {
   uint8_t i;
 
   // calculate color for first segment
-  set_segment_color_by_wheel(0, color);
+  set_segment_color_hsv(0, hue, sat, val);
 
   // copy values from first segment to other 3 segments
-  for (i=1;i<3;i++) {
+  for (i=1;i<BLADE_SEGMENTS;i++) {
     segment_color[i][RED_IDX] = segment_color[0][RED_IDX];
     segment_color[i][GRN_IDX] = segment_color[0][GRN_IDX];
     segment_color[i][BLU_IDX] = segment_color[0][BLU_IDX];
   }
 }
 
+const uint8_t *stock_color(uint8_t color_state) {
+  return stock_blade_colors[stock_blade_color_table_lookup[color_state >> 4][color_state & 0x0F]];
+}
+
 void set_blade_color(void) {
-  uint8_t color, color_table, i;
-  color = blade.color_state & 0x0F;
-  color_table = blade.color_state >> 4;
+  const uint8_t *color = stock_color(blade.color_state);
+  uint8_t i;
 
   for (i=0;i<BLADE_SEGMENTS;i++) {
-    segment_color[i][RED_IDX] = stock_blade_colors[stock_blade_color_table_lookup[color_table][color]][RED_IDX];
-    segment_color[i][GRN_IDX] = stock_blade_colors[stock_blade_color_table_lookup[color_table][color]][GRN_IDX];
-    segment_color[i][BLU_IDX] = stock_blade_colors[stock_blade_color_table_lookup[color_table][color]][BLU_IDX];
+    segment_color[i][RED_IDX] = color[RED_IDX];
+    segment_color[i][GRN_IDX] = color[GRN_IDX];
+    segment_color[i][BLU_IDX] = color[BLU_IDX];
   }
 }
 
@@ -247,7 +248,8 @@ void set_segment_brightness(uint8_t segment, uint8_t amount) {
 
   // segment_brightness is an 8-bit integer with a max value of 255
   // calculate the amount percentage of 255
-  segment_brightness[segment] = (uint8_t)(((float)amount/100) * 255);
+  segment_brightness[segment] = percent_to_u8(amount);
+  segment_dirty |= (1 << segment);
 }
 
 void set_blade_brightness(uint8_t amount) {
@@ -261,7 +263,8 @@ void set_max_segment_brightness(uint8_t segment, uint8_t amount) {
   if (amount > 100) {
     amount = 100;
   }
-  max_segment_brightness[segment] = (uint8_t)(((float)amount/100) * 255);
+  max_segment_brightness[segment] = percent_to_u8(amount);
+  segment_dirty |= (1 << segment);
 }
 
 void set_max_blade_brightness(uint8_t amount) {
@@ -270,60 +273,7 @@ void set_max_blade_brightness(uint8_t amount) {
   }
 }
 
-void mem_segment_color(uint8_t operation) {
-  static uint8_t backup_segment_color[BLADE_SEGMENTS][RGB_SIZE] = {{0,0,0},{0,0,0},{0,0,0},{0,0,0}};
-  uint8_t s, c;
-
-  if (operation == MEM_BLADE_BACKUP) {
-    for (s=0;s<BLADE_SEGMENTS;s++) {
-      for (c=0;c<RGB_SIZE;c++) {
-        backup_segment_color[s][c] = segment_color[s][c];
-      }
-    }
-  } else {
-    for (s=0;s<BLADE_SEGMENTS;s++) {
-      for (c=0;c<RGB_SIZE;c++) {
-        segment_color[s][c] = backup_segment_color[s][c];
-      }
-    }
-  }
-}
-
-void mem_segment_brightness(uint8_t operation) {
-  static uint8_t backup_segment_brightness[BLADE_SEGMENTS] = {0,0,0,0};
-  static uint8_t backup_max_segment_brightness[BLADE_SEGMENTS] = {0,0,0,0};
-  uint8_t s;
-
-  if (operation == MEM_BLADE_BACKUP) {
-    for (s=0;s<BLADE_SEGMENTS;s++) {
-      backup_segment_brightness[s] = segment_brightness[s];
-      backup_max_segment_brightness[s] = max_segment_brightness[s];
-    }
-  } else {
-    for (s=0;s<BLADE_SEGMENTS;s++) {
-      segment_brightness[s] = backup_segment_brightness[s];
-      max_segment_brightness[s] = backup_max_segment_brightness[s];
-    }
-  }
-}
-
-void mem_blade(uint8_t operation) {
-  static uint8_t backup_blade_state = 0;
-  static uint8_t backup_blade_color_state = 0;
-
-  if (operation == MEM_BLADE_BACKUP) {
-    backup_blade_state = blade.state;
-    backup_blade_color_state = blade.color_state;
-  } else {
-    blade.state = backup_blade_state;
-    blade.color_state = backup_blade_color_state;
-  }
-
-  // these two are broken into their own, separate functions as they may prove useful down the road.
-  mem_segment_color(operation);
-  mem_segment_brightness(operation);
-}
-
+#ifdef DEBUG_SERIAL_ENABLED
 void dump_segment_brightness(void) {
   uint8_t i;
   
@@ -371,3 +321,4 @@ void dump_blade_state(void) {
 
   serial_sendString("\r\n");
 }
+#endif
@@ -22,7 +22,12 @@
 // BLADE COLOR
 
 // adjust RED channel value to match stock blades which use a series diode to drop it's brightness
-#define RED_ADJUST  .79
+#define RED_ADJUST  Q16(.79)   // Q16 fraction, see fixed.h
+
+// stock white blade color; also the color the color picker blends toward at its brighter levels
+#define STOCK_BLADE_WHITE_RED   112
+#define STOCK_BLADE_WHITE_GRN   112
+#define STOCK_BLADE_WHITE_BLU   112
 
 // blade color table R, G, B index values
 #define RED_IDX   0
@@ -54,9 +59,19 @@
 #define STOCK_BLADE_COLOR_FLASH_ORANGE  12
 #define STOCK_BLADE_COLOR_LEN           13  // total number of colors supported by STOCK blades
 
-// MEM Operation
-#define MEM_BLADE_BACKUP      0
-#define MEM_BLADE_RESTORE     1
+// STOCK FLICKER (Kylo Ren legacy hilt)
+#define STOCK_FLICKER_LEVELS      32    // 16 levels for each of the two flicker commands
+#define STOCK_FLICKER_DECAY_TIME  40    // time, in milliseconds, to fade from peak to settle brightness
+#define STOCK_FLICKER_DECAY_RECIP 205   // 8192 / STOCK_FLICKER_DECAY_TIME; lets the fade avoid a division
+
+// STOCK ANIMATION timing (see animate_handler.c)
+#define ANIMATE_STEP_TIME         85    // time, in milliseconds, the stock ignition takes to sweep one segment, and between extinguish keyframes
+#define ANIMATE_CLASH_TIME        40    // time, in milliseconds, the blade is held at full brightness during a clash
+#define ANIMATE_CLASH_SETTLE_TIME 80    // time, in milliseconds, for the clash flash to fade back into the blade afterward
+#define ANIMATE_DELAY_UNIT        5     // extinguish delays are stored in units of this many milliseconds
+
+// 65536 / ANIMATE_STEP_TIME, rounded up; lets keyframe interpolation avoid a division
+#define ANIMATE_STEP_RECIP        ((65536UL + ANIMATE_STEP_TIME - 1) / ANIMATE_STEP_TIME)
 
 // RESET Configuration
 #define RESET_THRESHOLD_COUNT 13    // how many on/off cycles before a reset is triggered; suggested value: ((DMODE_MAX * 2) + 1)
@@ -67,6 +82,12 @@
 extern "C" {
 #endif
 
+// where an extinguish animation begins for a given stock blade color
+struct extinguish_timing_struct {
+  uint8_t delay;                          // hold the blade on for this many ANIMATE_DELAY_UNITs before the first keyframe
+  uint8_t start;                          // index of the first extinguish keyframe to play
+};
+
 // a struct that contains the blade state varaibles
 struct blade_state_struct {
   uint8_t state;              // HIGH nibble = state, LOW nibble = state step counter or other variable for use with the state
@@ -76,14 +97,18 @@ struct blade_state_struct {
   uint8_t dmode_step;         // multipurpose variable, usage depends on the current dmode
 };
 
+// GLOBAL: extinguish_timing[2][16] - extinguish timing of each stock color; savi (0) or legacy (1), then color
+extern const struct extinguish_timing_struct extinguish_timing[2][STOCK_BLADE_COLORS_PER_TABLE];
+
 // GLOBAL: blade - the current state of the blade
 extern struct blade_state_struct blade;
 
 // flag that tells the blade the blade state has been loaded from eeprom
 extern uint8_t state_loaded_from_eeprom;
 
-// GLOBAL: segment_color[4][3] - keep track of the blade segments' color
-extern volatile uint8_t segment_color[BLADE_SEGMENTS][RGB_SIZE];
+// GLOBAL: segment_color[4][3] - keep track of the blade segments' color; this is the base layer
+//         that render_handler() composites into render_color (see render.h)
+extern uint8_t segment_color[BLADE_SEGMENTS][RGB_SIZE];
 
 // GLOBAL: segment_brightness[4] - keep track of a segment's brightness
 extern uint8_t segment_brightness[BLADE_SEGMENTS];
@@ -92,26 +117,35 @@ extern uint8_t segment_brightness[BLADE_SEGMENTS];
 //         animating ignition and extinguish animations
 extern uint8_t max_segment_brightness[BLADE_SEGMENTS];
 
+// GLOBAL: segment_dirty - bit n is set when segment n's segment_brightness or max_segment_brightness has
+//         changed; true_segment_brightness_handler() only recalculates segments whose bit is set.
+//         code that writes to the brightness arrays directly must set the segment's bit
+extern uint8_t segment_dirty;
+#define SEGMENT_DIRTY_ALL ((1 << BLADE_SEGMENTS) - 1)
+
 // GLOBAL: true_segment_brightness[4] - keep track of a segment's brightness relative to maximum brightness
 //         this value is used by pwm_handler() to set a given segment's brightness
 extern volatile uint8_t true_segment_brightness[BLADE_SEGMENTS];
 
+// constant tables are declared const so they stay in flash. the ATtiny's flash is mapped into the data
+// address space, so they're read with ordinary array indexing and take up no RAM
+
 // GLOBAL: stock_blade_colors[9][3] - blade color lookup table
 //         this table is used to lookup RGB color values for specific colors produced by STOCK blades
 //         value/255 = PWM duty cycle needed to produce the color
-extern uint8_t stock_blade_colors[STOCK_BLADE_COLOR_LEN][RGB_SIZE];
+extern const uint8_t stock_blade_colors[STOCK_BLADE_COLOR_LEN][RGB_SIZE];
 
 // GLOBAL: blade_color_table_lookup - this 2D table contains color lookup values for stock Galaxy's Edge lightsabers
 //         each color has a corresponding CLASH color, used to produce a brief flash when the blade hits another blade
 //         the organization of this table is every EVENT number table contains the normal color value and every odd value table
 //         contains the clash color values of its preceding normal color table.
-extern uint8_t stock_blade_color_table_lookup[STOCK_BLADE_COLOR_TABLES][STOCK_BLADE_COLORS_PER_TABLE];
+extern const uint8_t stock_blade_color_table_lookup[STOCK_BLADE_COLOR_TABLES][STOCK_BLADE_COLORS_PER_TABLE];
 
 // GLOBAL: multi-color blade presets
-extern uint8_t blade_multi_colors[][BLADE_SEGMENTS][RGB_SIZE];
+extern const uint8_t blade_multi_colors[][BLADE_SEGMENTS][RGB_SIZE];
 
 // GLOBAL: keep track of how many multi-color blade presets there are
-extern uint8_t blade_multi_colors_len;
+extern const uint8_t blade_multi_colors_len;
 
 // set a custom color value for a specific segment
 void set_custom_segment_color(uint8_t segment, uint8_t red, uint8_t green, uint8_t blue);
@@ -130,13 +164,15 @@ void clear_blade_color(void);
 // direction != 0: shift forwards
 void rotate_segment_color(uint8_t direction);
 
-// set RGB color values based on a single byte
-// design of this function is such that incrementing the value
-// will produce a smooth transition through the color wheel
-void set_segment_color_by_wheel(uint8_t segment, uint8_t wheel_value);
+// set a segment's color from a hue (0-65535), saturation (0-255) and value (0-255); see hsv.h
+// incrementing the hue produces a smooth transition through the color wheel
+void set_segment_color_hsv(uint8_t segment, uint16_t hue, uint8_t sat, uint8_t val);
 
-// set the blade's color based on a single byte value
-void set_color_by_wheel(uint8_t color);
+// set the blade's color from a hue, saturation and value
+void set_blade_color_hsv(uint16_t hue, uint8_t sat, uint8_t val);
+
+// look up the RGB values of a stock blade color; color_state is encoded as in blade_state_struct
+const uint8_t *stock_color(uint8_t color_state);
 
 // set the blade color using the stock color lookup tables and the value stored 
 // in the global blade_state variable
@@ -154,39 +190,32 @@ void set_max_segment_brightness(uint8_t segment, uint8_t amount);
 // 
 void set_max_blade_brightness(uint8_t amount);
 
-// backup/restore the blade's color from memory (NOT EEPROM)
-//  operation = 0: backup current blade state
-// operation != 0: restore current blade state
-void mem_segment_color(uint8_t operation);
-
-// backup/restore the blade's brightness from memory (NOT EEPROM)
-//  operation = 0: backup current blade state
-// operation != 0: restore current blade state
-void mem_segment_brightness(uint8_t operation);
-
-// use to create or restore a backup of the blade's state
-//  operation = 0: backup current blade state
-// operation != 0: restore current blade state
-void mem_blade(uint8_t operation);
-
+#ifdef DEBUG_SERIAL_ENABLED
 // dump the segment brightness array to serial
 void dump_segment_brightness(void);
 
 // dump the contents of blade struct to serial
 void dump_blade_state(void);
+#endif
 
 // process any new command from the hilt and adjust the state of the blade as needed.
 void command_handler(void);
 
+// disable the LDO and stop any speculative ignite (see DATA_SPECULATIVE_IGNITE); called before the blade goes to sleep
+void speculative_ignite_cancel(void);
+
+// apply a stock flicker level (0-15 _FLICKER_1, 16-31 _FLICKER_2) and put the blade in the stock flicker state
+void stock_flicker_start(uint8_t level);
+
 // manage the blade if it's in a state that requires animation, such as power-on, power-off, clash
 void animate_handler(void);
 
-// calculate the brightness of each segment relative to its maximum brightness and store it
-// in the true_segment_brightness array. these calculated values will be used by pwm_handler()
+// calculate the brightness of each segment relative to its maximum brightness, raised by any
+// overlay (see render.h), and store it in the true_segment_brightness array. these calculated values will be used by pwm_handler()
 // to set the segment's actual brightness
 //
-// calculations are done outside of pwm_handler() because the floating-point calculations
-// were slowing pwm_handler() down too much
+// calculations are done outside of pwm_handler() to keep pwm_handler() as short as possible.
+// only segments flagged in segment_dirty are recalculated
 void true_segment_brightness_handler(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,67 @@
+/* calib.c
+ *
+ * color calibration; see calib.h
+ *
+ */
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+#include "blade_state.h"
+#include "eeprom.h"
+#include "calib.h"
+
+// matrix * gain for each segment, in Q8; calib_coef[segment][output channel][input channel]
+static int16_t calib_coef[BLADE_SEGMENTS][RGB_SIZE][RGB_SIZE];
+
+// set when the calibration changes nothing, so calib_apply() can copy colors straight through
+static uint8_t calib_identity = 1;
+
+// read a byte of the calibration block
+static uint8_t calib_byte(uint8_t offset) {
+  return eeprom_read_byte((uint8_t *)(EEPROM_CALIB_ADDR + offset));
+}
+
+void calib_load(void) {
+  uint8_t s, o, i, gain;
+  int16_t m;
+
+  calib_identity = 1;
+  if (calib_byte(0) != CALIB_VERSION) {
+    return;
+  }
+
+  for (s=0;s<BLADE_SEGMENTS;s++) {
+    gain = calib_byte(1 + (RGB_SIZE * RGB_SIZE * 2) + s);
+    for (o=0;o<RGB_SIZE;o++) {
+      for (i=0;i<RGB_SIZE;i++) {
+        m = (int16_t)(calib_byte(1 + (((o * RGB_SIZE) + i) * 2)) | ((uint16_t)calib_byte(2 + (((o * RGB_SIZE) + i) * 2)) << 8));
+
+        // fold the segment's gain into the matrix; gain / 255 is taken as gain / 256 plus a bit of rounding
+        calib_coef[s][o][i] = (int16_t)(((int32_t)m * (gain + (gain >> 7))) >> 8);
+
+        if (calib_coef[s][o][i] != ((o == i) ? 256 : 0)) {
+          calib_identity = 0;
+        }
+      }
+    }
+  }
+}
+
+void calib_apply(uint8_t segment, const uint8_t *in, volatile uint8_t *out) {
+  const int16_t (*coef)[RGB_SIZE] = calib_coef[segment];
+  uint8_t o;
+  int32_t x;
+
+  if (calib_identity) {
+    out[RED_IDX] = in[RED_IDX];
+    out[GRN_IDX] = in[GRN_IDX];
+    out[BLU_IDX] = in[BLU_IDX];
+    return;
+  }
+
+  for (o=0;o<RGB_SIZE;o++) {
+    x = (int32_t)coef[o][RED_IDX] * in[RED_IDX] + (int32_t)coef[o][GRN_IDX] * in[GRN_IDX] + (int32_t)coef[o][BLU_IDX] * in[BLU_IDX];
+    x = (x + 128) >> 8;
+    out[o] = (x < 0) ? 0 : (x > 255) ? 255 : (uint8_t)x;
+  }
+}
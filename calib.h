@@ -0,0 +1,44 @@
+/* calib.h
+ *
+ * per-device color calibration. LEDs from different batches of blades differ in white point and from
+ * segment to segment, so every color the blade displays is passed through a 3x3 channel matrix and a
+ * per-segment gain before it reaches the PWM:
+ *
+ *   out[o] = gain[segment] * (matrix[o][RED] * in[RED] + matrix[o][GRN] * in[GRN] + matrix[o][BLU] * in[BLU])
+ *
+ * the calibration block is stored in EEPROM (EEPROM_CALIB_ADDR) and written with extended commands
+ * (DATA_EXT_TYPE_CALIBRATION). its layout is:
+ *
+ *   offset  bytes   contents
+ *   0       1       CALIB_VERSION; the block is ignored, and colors passed through unchanged, unless it matches
+ *   1       18      matrix[3][3], rows are output channels (red, green, blue); signed 16-bit Q8 values,
+ *                   low byte first, 256 = 1.0
+ *   19      4       gain of each segment; 255 = 1.0
+ *
+ * calib_load() bakes the matrix and gains into one set of coefficients per segment whenever the block
+ * changes, so correcting a color is 9 integer multiplies and no division. an identity calibration,
+ * the default, is detected when it's baked and skipped entirely.
+ *
+ */
+
+#ifndef CALIB_H_
+#define CALIB_H_
+
+#define CALIB_VERSION     0x01
+#define CALIB_LEN         (1 + (RGB_SIZE * RGB_SIZE * 2) + BLADE_SEGMENTS)  // size of the calibration block in bytes
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// read the calibration block from EEPROM and bake it; call at startup and whenever the block is written
+void calib_load(void);
+
+// correct color in for display on the given segment, writing the result to out
+void calib_apply(uint8_t segment, const uint8_t *in, volatile uint8_t *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* CALIB_H_ */
@@ -9,6 +9,132 @@
 #include "data.h"
 #include "blade_state.h"
 #include "dmode_handler.h"
+#include "pwm.h"
+#include "eeprom.h"
+#include "latency.h"
+#include "fade.h"
+#include "script.h"
+#include "calib.h"
+
+// a script or calibration stored by an extended command is reloaded once it has been written to EEPROM
+#define EXT_RELOAD_SCRIPT       0x01
+#define EXT_RELOAD_CALIBRATION  0x02
+
+static uint8_t ext_reload = 0;
+
+// process an extended command frame received by data_handler(). returns 0 if the frame couldn't be
+// processed yet because its data can't be queued for EEPROM; it's processed again on the next pass
+uint8_t ext_command_handler(void) {
+  uint8_t i;
+
+  // extended commands only alter dmode settings, so ignore them if dmode is disabled
+  if ((switch_config & (1 << SW_DMODE_DISABLE_bp)) == 0) {
+    switch (data_ext_frame.type) {
+      case DATA_EXT_TYPE_SEGMENT_COLORS:
+        if (data_ext_frame.len == BLADE_SEGMENTS * RGB_SIZE) {
+          for (i=0; i<BLADE_SEGMENTS * RGB_SIZE; i++) {
+            ((uint8_t*)custom_segment_colors)[i] = data_ext_frame.payload[i];
+          }
+          eeprom_store_custom_colors();
+
+          // dmode_handler() applies the colors when entering DMODE_CUSTOM, so only apply them here if already in it
+          if (blade.dmode == DMODE_CUSTOM) {
+            apply_custom_segment_colors();
+          } else {
+            blade.dmode = DMODE_CUSTOM;
+            blade.dsubmode = DSUBMODE_NORMAL;
+          }
+        }
+        break;
+
+      case DATA_EXT_TYPE_DMODE:
+        if (data_ext_frame.len == 3 && (data_ext_frame.payload[0] < DMODE_MAX || data_ext_frame.payload[0] == DMODE_CUSTOM || data_ext_frame.payload[0] == DMODE_SCRIPT)) {
+          blade.dmode = data_ext_frame.payload[0];
+          blade.dsubmode = data_ext_frame.payload[1];
+          blade.dmode_step = data_ext_frame.payload[2];
+        }
+        break;
+
+      case DATA_EXT_TYPE_EFFECT:
+        if (data_ext_frame.len == 2) {
+          blade.dsubmode = data_ext_frame.payload[0];
+          dmode_effect_period = data_ext_frame.payload[1];
+        }
+        break;
+
+      case DATA_EXT_TYPE_SCRIPT:
+        if (data_ext_frame.len >= 2) {
+          if (eeprom_store_script(data_ext_frame.payload[0], &data_ext_frame.payload[1], data_ext_frame.len - 1) == 0) {
+            return 0;
+          }
+          ext_reload |= EXT_RELOAD_SCRIPT;
+        }
+        break;
+
+      case DATA_EXT_TYPE_CALIBRATION:
+        if (data_ext_frame.len >= 2) {
+          if (eeprom_store_calibration(data_ext_frame.payload[0], &data_ext_frame.payload[1], data_ext_frame.len - 1) == 0) {
+            return 0;
+          }
+          ext_reload |= EXT_RELOAD_CALIBRATION;
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  #ifdef DEBUG_SERIAL_ENABLED
+    snprintf(serial_buf, SERIAL_BUF_LEN, "EXT CMD: type %02x, len %d\r\n", data_ext_frame.type, data_ext_frame.len);
+    serial_sendString(serial_buf);
+  #endif
+  return 1;
+}
+
+#ifdef DATA_SPECULATIVE_IGNITE
+#define SPECULATE_IDLE      0   // not speculating
+#define SPECULATE_ACTIVE    1   // the LDO is on, waiting for the rest of a command that looks like an ignite
+#define SPECULATE_EXPIRED   2   // the rest of the command never arrived; the LDO is off again
+
+static uint8_t speculating = SPECULATE_IDLE;
+static uint32_t speculate_time = 0;     // time the LDO was enabled
+
+// enable the LDO as soon as a partially received command looks like an ignite, and disable it
+// again if the completed command is something else or it doesn't complete. see DATA_SPECULATIVE_IGNITE in data.h
+void speculative_ignite_handler(void) {
+
+  // only speculate while the blade is off
+  if (blade.state != BLADE_STATE_OFF) {
+    speculating = SPECULATE_IDLE;
+
+  // the first 4 bits of an ignite have arrived; power up. the blade state is left alone until the
+  // command completes, and animate_handler() sets up the ignition as usual
+  } else if (speculating == SPECULATE_IDLE) {
+    if (data_cmd_partial == DATA_CMD_ON || data_cmd_partial == DATA_CMD_ON_LEGACY) {
+      blade_power_on();
+      speculating = SPECULATE_ACTIVE;
+      speculate_time = millis();
+    }
+
+  // the command has completed (or was abandoned) and it's not an ignite; cancel
+  } else if (data_cmd_partial == 0 && (data_cmd & 0xF0) != DATA_CMD_ON && (data_cmd & 0xF0) != DATA_CMD_ON_LEGACY) {
+    blade_power_off();
+    speculating = SPECULATE_IDLE;
+
+  // the data line stopped or glitched part way through the command, so data_cmd_partial may not be
+  // cleared until the next preamble; don't leave the LDO on until then
+  } else if (speculating == SPECULATE_ACTIVE && (millis() - speculate_time) > DATA_SPECULATIVE_TIMEOUT) {
+    blade_power_off();
+    speculating = SPECULATE_EXPIRED;
+  }
+}
+
+void speculative_ignite_cancel(void) {
+  blade_power_off();
+  speculating = SPECULATE_IDLE;
+}
+#endif
 
 void command_handler(void) {
   static uint32_t last_off_time = 0;
@@ -17,6 +143,29 @@ void command_handler(void) {
   uint8_t cmd, color;
   uint32_t time_now = millis();
 
+  #ifdef DATA_SPECULATIVE_IGNITE
+    speculative_ignite_handler();
+  #endif
+
+  // data_ext_frame is populated by data_handler() when a complete extended command frame is received.
+  // a frame that can't be processed yet is kept until it can; data_handler() won't overwrite it
+  if (data_ext_ready != 0 && ext_command_handler() != 0) {
+    data_ext_ready = 0;
+  }
+
+  // stores to EEPROM complete in the background; reload what an extended command changed once they have
+  if (ext_reload != 0 && eeprom_commit_pending == 0) {
+
+    // restart the running script so it doesn't continue part way into code that has changed
+    if ((ext_reload & EXT_RELOAD_SCRIPT) && blade.dmode == DMODE_SCRIPT) {
+      script_select(blade.dsubmode);
+    }
+    if (ext_reload & EXT_RELOAD_CALIBRATION) {
+      calib_load();
+    }
+    ext_reload = 0;
+  }
+
   // data_cmd is populated by data_handler() and reset to 0 after being processed by command_handler()
 
   // is a new command available for processing?
@@ -28,10 +177,30 @@ void command_handler(void) {
 
     // reset data_cmd which implicitly acknowledges the command has been received
     data_cmd = 0;
+    LATENCY_MARK(LATENCY_STAGE_COMMAND);
+
+    // record the command in the data line telemetry
+    #ifdef DATA_TELEMETRY_ENABLED
+      DATA_TELEMETRY_INC(data_telemetry.cmd[cmd >> 4]);
+      if (color_derez != SINGLE_COLOR_DEREZ) {
+        DATA_TELEMETRY_INC(data_telemetry.multi_mode);
+      }
+    #endif
 
     switch (cmd) {
       case DATA_CMD_ON:
       case DATA_CMD_ON_LEGACY:
+
+        // report how long it took to ignite after waking from sleep
+        #ifdef DEBUG_SERIAL_ENABLED
+          if (wake_time != 0) {
+            snprintf(serial_buf, SERIAL_BUF_LEN, "Wake to ignite: %lu ms\r\n", (time_now - wake_time));
+            serial_sendString(serial_buf);
+          }
+        #endif
+        wake_time = 0;
+
+        fade_finish();    // a fade left over from before the blade was turned off must not overwrite the new color
         last_on_time = time_now;
         blade.state = BLADE_STATE_POWER_ON;
         set_max_blade_brightness(0);
@@ -107,9 +276,11 @@ void command_handler(void) {
 
       case DATA_CMD_COLOR:
         if (blade.dmode == DMODE_STOCK && blade.dsubmode == DSUBMODE_NORMAL) {    // ignore command unless blade is in stock mode
-          blade.state = BLADE_STATE_ON;
+          fade_capture();
           blade.color_state = color + (STOCK_BLADE_COLOR_TABLE_SAVI << 4);
           set_blade_color();
+          fade_start(((blade.state & 0xF0) == BLADE_STATE_ON) ? FADE_TIME_COLOR : 0); // only blend if the blade was already lit
+          blade.state = BLADE_STATE_ON;
           set_max_blade_brightness(100);
         }
         #ifdef DEBUG_SERIAL_ENABLED
@@ -119,9 +290,11 @@ void command_handler(void) {
 
       case DATA_CMD_COLOR_LEGACY:
         if (blade.dmode == DMODE_STOCK && blade.dsubmode == DSUBMODE_NORMAL) {    // ignore command unless blade is in stock mode
-          blade.state = BLADE_STATE_ON;
+          fade_capture();
           blade.color_state = color + (STOCK_BLADE_COLOR_TABLE_LEGACY << 4);
           set_blade_color();
+          fade_start(((blade.state & 0xF0) == BLADE_STATE_ON) ? FADE_TIME_COLOR : 0); // only blend if the blade was already lit
+          blade.state = BLADE_STATE_ON;
           set_max_blade_brightness(100);
         }
         break;
@@ -129,18 +302,16 @@ void command_handler(void) {
       case DATA_CMD_REDFLICKER_1:
 
         // only flicker if brightness is not being manipulated elsewhere (dmode_handler())
-        if ( blade.dmode == DMODE_BLADE_WHEEL || blade.dmode == DMODE_SEGMENT_WHEEL || blade.dmode == DMODE_MULTI_MODE || blade.dsubmode == DSUBMODE_NORMAL ) {
-          blade.state = BLADE_STATE_STOCK_FLICKER;
-          blade.color_state = color;
+        if (dmode_brightness_effect == DSUBMODE_NORMAL) {
+          stock_flicker_start(color);
         }
         break;
 
       case DATA_CMD_REDFLICKER_2:
 
         // only flicker if brightness is not being manipulated elsewhere (dmode_handler())
-        if ( blade.dmode == DMODE_BLADE_WHEEL || blade.dmode == DMODE_SEGMENT_WHEEL || blade.dmode == DMODE_MULTI_MODE || blade.dsubmode == DSUBMODE_NORMAL ) {
-          blade.state = BLADE_STATE_STOCK_FLICKER | (1<<2);
-          blade.color_state = color;
+        if (dmode_brightness_effect == DSUBMODE_NORMAL) {
+          stock_flicker_start(color + 16);
         }
         break;
 
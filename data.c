@@ -4,27 +4,122 @@
 
 #include <stdio.h>
 #include <avr/interrupt.h>
+#include <util/crc16.h>
 #include "data.h"
 #include "millis.h"
 #include "serial.h"
+#include "latency.h"
 
 // initialize global variables
 uint8_t data_cmd = 0;
+uint8_t data_cmd_partial = 0;
+uint8_t data_ext_ready = 0;
+struct data_ext_frame_struct data_ext_frame;
 volatile struct data_cbuf_struct cbuf[DATA_CBUF_LEN];
 volatile uint8_t data_cbuf_rpos = 0;
 volatile uint8_t data_cbuf_wpos = 0;
+uint8_t data_resync = 0;
+#ifdef DATA_TELEMETRY_ENABLED
+volatile struct data_telemetry_struct data_telemetry;
+#endif
 
 // Data Pin State Change Interrupt Service Request
 // triggered when the state of the data pin changes
 // ISRs need to be as brief as possible, so just record the state and time of 
 // change to a buffer which will be processed later by data_handler()
+//
+// if the buffer is full the state change is dropped; writing it would advance data_cbuf_wpos onto
+// data_cbuf_rpos and make the whole buffer look empty to data_handler()
 ISR(DATA_PIN_ISR) {
-  cbuf[data_cbuf_wpos].state = DATA_PORT.IN & DATA_PIN_bm;      // record pin state to the buffer
-  cbuf[data_cbuf_wpos].state_time = micros();                   // record time (in microseconds) to the buffer
-  data_cbuf_wpos = (data_cbuf_wpos + 1) & (DATA_CBUF_LEN - 1);  // increment write buffer position
+  uint8_t next_wpos = (data_cbuf_wpos + 1) & (DATA_CBUF_LEN - 1);
+
+  DATA_TELEMETRY_INC(data_telemetry.edges);
+  if (next_wpos != data_cbuf_rpos) {
+    cbuf[data_cbuf_wpos].state = DATA_PORT.IN & DATA_PIN_bm;    // record pin state to the buffer
+    cbuf[data_cbuf_wpos].state_time = micros();                 // record time (in microseconds) to the buffer
+    data_cbuf_wpos = next_wpos;                                 // increment write buffer position
+  } else {
+    DATA_TELEMETRY_INC(data_telemetry.overruns);
+  }
   DATA_PORT.INTFLAGS |= DATA_PIN_bm;                            // clear the interrupt
 }
 
+// feed a decoded byte to the extended command frame parser
+// returns 1 if the byte belongs to an extended command frame, 0 if it's a regular command. the first
+// escape byte is always a regular command as well: until the second one arrives there's no telling it
+// from a hilt command of the same value, and holding it back would lose it when no frame follows
+uint8_t data_ext_receive(uint8_t byte) {
+  static uint8_t pos = 0;         // position within the frame; 0 = waiting for DATA_EXT_ESC_1
+  static uint8_t crc = 0;
+  static uint8_t len = 0;
+  static uint8_t held = 0;        // 1 if data_ext_frame still holds a frame command_handler() hasn't processed
+  static uint32_t last_time = 0;
+  uint32_t time_now = millis();
+
+  // abandon a frame that has stalled
+  if (pos != 0 && (time_now - last_time) > DATA_EXT_TIMEOUT) {
+    pos = 0;
+  }
+  last_time = time_now;
+
+  switch (pos) {
+    case 0:                       // first escape byte; passed on as a regular command too
+      if (byte == DATA_EXT_ESC_1) {
+        pos++;
+      }
+      return 0;
+
+    case 1:                       // second escape byte; anything else is a regular command
+      if (byte != DATA_EXT_ESC_2) {
+        pos = 0;
+        return 0;
+      }
+      crc = 0;
+      break;
+
+    case 2:                       // length
+      if (byte > DATA_EXT_MAX_LEN) {
+        pos = 0;
+        return 1;
+      }
+      len = byte;
+      held = data_ext_ready;      // a frame still held by command_handler() is not overwritten; this one is dropped
+      if (held == 0) {
+        data_ext_frame.len = byte;
+      }
+      crc = _crc8_ccitt_update(crc, byte);
+      break;
+
+    case 3:                       // type
+      if (held == 0) {
+        data_ext_frame.type = byte;
+      }
+      crc = _crc8_ccitt_update(crc, byte);
+      break;
+
+    default:
+      if ((pos - 4) < len) {                  // payload
+        if (held == 0) {
+          data_ext_frame.payload[pos - 4] = byte;
+        }
+        crc = _crc8_ccitt_update(crc, byte);
+      } else {                                // CRC; frame is complete
+        if (crc == byte) {
+          if (held == 0) {
+            data_ext_ready = 1;
+          } else {
+            DATA_TELEMETRY_INC(data_telemetry.dropped);
+          }
+        }
+        pos = 0;
+        return 1;
+      }
+      break;
+  }
+  pos++;
+  return 1;
+}
+
 void data_setup(void) {
 
   // initialize DATA pin as input and enable pullup
@@ -43,6 +138,16 @@ void enable_data_pin(void) {
   DATA_PORT.DATA_PIN_CTRL |= PORT_PULLUPEN_bm;
 }
 
+// the command that wakes the MCU from power-down is normally an ignite. the edge that wakes the MCU
+// is timestamped only after the main clock has restarted, and because PC3 is not a fully asynchronous
+// pin the active edge of the preamble may not be recorded at all. data_handler() uses data_resync
+// to treat the first edge after waking as the start (or end) of a preamble, so the command that
+// follows decodes without waiting for the hilt to repeat it.
+void data_sleep(void) {
+  data_resync = 1;
+  data_cmd_partial = 0;   // a command cut short before sleep is abandoned
+}
+
 void data_handler(void) {
   static uint8_t cmd = 0;         // a variable to hold the command byte as it's being received from the hilt
   static uint8_t bit_cnt = 0;     // counting the number of bits received
@@ -58,6 +163,20 @@ void data_handler(void) {
   current_time = cbuf[data_cbuf_rpos].state_time;                 // read time of state from buffer
   data_cbuf_rpos = (data_cbuf_rpos + 1) & (DATA_CBUF_LEN - 1);    // increment read buffer position
 
+  // first edge after waking from sleep; micros() did not advance while asleep, so the time since
+  // the last edge before sleep means nothing. start a fresh command from this edge:
+  //   ACTIVE - the start of the preamble; its length is measured from here as usual
+  //   IDLE   - the ACTIVE edge that woke the MCU was missed; assume the pin was held active for
+  //            the preamble and wait for the bits that follow
+  if (data_resync != 0) {
+    data_resync = 0;
+    last_time = current_time;
+    bit_cnt = 0;
+    cmd = 0;
+    data_cmd_partial = 0;
+    return;
+  }
+
   // calculate time difference since last state change on data pin
   // this is convoluted because we have to worry about the microsecond counter overflowing between measurements
   if (current_time >= last_time) {
@@ -76,14 +195,29 @@ void data_handler(void) {
   // this is probably not the "correct" way to do this, but it works well enough
   if (data_state == DATA_IDLE) {
     if (time_diff < DATA_BIT_MAX_LEN) {         // active for less than DATA_BIT_MAX_LEN microseconds indicates a bit
+      if (time_diff < DATA_RUNT_MAX_LEN) {
+        DATA_TELEMETRY_INC(data_telemetry.runts);
+      }
       cmd <<= 1;                                // shift the byte left by 1 position
       if (time_diff < DATA_BIT_ONE_MAX_LEN) {   // active for less than 1.8ms we'll assume indicates a bit value of 1 (longer time = bit value 0)
         cmd++;                                  // add one to the byte value
       }
-      if (++bit_cnt == 8) {                     // if 8 bits have been recorded, send it to the program and reset the local bit count and command byte values
-        data_cmd = cmd;                         // copy decoded command to the global variable which will be picked up by command_handler()
+      if (++bit_cnt == 4) {                     // high nibble is in; publish it for a speculative ignite
+        data_cmd_partial = cmd << 4;
+      } else if (bit_cnt == 8) {                // if 8 bits have been recorded, send it to the program and reset the local bit count and command byte values
+        DATA_TELEMETRY_INC(data_telemetry.frames);
+        if (data_ext_receive(cmd) == 0) {       // bytes of an extended command frame, after the first, are not regular commands
+          if (data_cmd != 0) {                  // previous command was never picked up by command_handler()
+            DATA_TELEMETRY_INC(data_telemetry.dropped);
+          }
+          data_cmd = cmd;                       // copy decoded command to the global variable which will be picked up by command_handler()
+          #ifdef LATENCY_TRACE_ENABLED
+            latency_start(cmd, current_time);
+          #endif
+        }
         bit_cnt = 0;
         cmd = 0;
+        data_cmd_partial = 0;
         
 /*        #ifdef DEBUG_SERIAL_ENABLED
           serial_sendString("CMD: ");
@@ -93,8 +227,36 @@ void data_handler(void) {
         #endif
 */      }
     } else {  // if active over 10ms then it's likely a preamble to an incoming command, so reset bit count and command byte values
+      DATA_TELEMETRY_INC(data_telemetry.preambles);
+      if (bit_cnt != 0) {
+        DATA_TELEMETRY_INC(data_telemetry.aborted);
+      }
       bit_cnt = 0;
       cmd = 0;
+      data_cmd_partial = 0;
+    }
+  }
+}
+
+#if defined(DATA_TELEMETRY_ENABLED) && defined(DEBUG_SERIAL_ENABLED)
+void data_telemetry_dump(void) {
+  uint8_t i;
+
+  serial_sendString("DATA TELEMETRY:\r\n");
+  snprintf(serial_buf, SERIAL_BUF_LEN, "  edges: %u, overruns: %u\r\n", data_telemetry.edges, data_telemetry.overruns);
+  serial_sendString(serial_buf);
+  snprintf(serial_buf, SERIAL_BUF_LEN, "  runts: %u, preambles: %u, aborted: %u\r\n", data_telemetry.runts, data_telemetry.preambles, data_telemetry.aborted);
+  serial_sendString(serial_buf);
+  snprintf(serial_buf, SERIAL_BUF_LEN, "  frames: %u, dropped: %u, multi-mode: %u\r\n", data_telemetry.frames, data_telemetry.dropped, data_telemetry.multi_mode);
+  serial_sendString(serial_buf);
+  serial_sendString("  commands:");
+  for (i=0; i<16; i++) {
+    if (i == 8) {
+      serial_sendString("\r\n           ");
     }
+    snprintf(serial_buf, SERIAL_BUF_LEN, " %X0:%u", i, data_telemetry.cmd[i]);
+    serial_sendString(serial_buf);
   }
+  serial_sendString("\r\n\r\n");
 }
+#endif
@@ -32,10 +32,69 @@
 #define DATA_CMD_7            0xE0  // turns blade off; (disable blade until it is unplugged?)
 #define DATA_CMD_7_LEGACY     0xF0  //
 
+// SPECULATIVE IGNITE
+// the high nibble of a command is enough to identify an ignite. with DATA_SPECULATIVE_IGNITE defined,
+// command_handler() enables the LDO as soon as the first 4 bits of DATA_CMD_ON or DATA_CMD_ON_LEGACY
+// have been received, giving the LDO time to settle while the rest of the command arrives. if the
+// command turns out to be something else, or doesn't finish within DATA_SPECULATIVE_TIMEOUT, the LDO is
+// disabled again. animate_handler() doesn't wait for the LDO before showing the first ignition keyframe,
+// so the head start only helps LEDs that are slow to light once powered, and no gain has been measured;
+// it's off by default. uncomment to enable.
+//#define DATA_SPECULATIVE_IGNITE
+#define DATA_SPECULATIVE_TIMEOUT  ((4 * 2 * DATA_BIT_MAX_LEN) / 1000)  // milliseconds; the last 4 bits, each no longer than the longest bit plus an equal gap
+
+// EXTENDED COMMANDS
+//
+// modified hilts can send multi-byte frames built on top of the 8-bit commands. a frame starts with
+// two escape bytes made from command codes stock hilts don't use (DATA_CMD_7_LEGACY and DATA_CMD_0),
+// followed by a length byte, a type byte, the payload, and a CRC-8 (CCITT) over the length, type, and
+// payload bytes:
+//
+//   DATA_EXT_ESC_1  DATA_EXT_ESC_2  LEN  TYPE  PAYLOAD[LEN]  CRC
+//
+// bytes that belong to a frame are not passed on to command_handler() as regular commands, except the
+// first escape byte: a hilt can send it on its own, and it can't be told apart until the next byte
+// arrives. command_handler() takes no action on DATA_CMD_7_LEGACY, so a frame's first byte only shows
+// up in the telemetry and latency traces. a frame that stalls for longer than DATA_EXT_TIMEOUT or fails
+// its CRC is discarded, as is one that arrives while command_handler() still holds the last frame
+// because its data couldn't be queued for EEPROM yet.
+#define DATA_EXT_ESC_1                0xF5  // first escape byte
+#define DATA_EXT_ESC_2                0x0A  // second escape byte
+#define DATA_EXT_MAX_LEN              12    // maximum payload length, in bytes
+#define DATA_EXT_TIMEOUT              100   // maximum time, in milliseconds, between two bytes of a frame
+
+// EXTENDED COMMAND TYPES
+#define DATA_EXT_TYPE_SEGMENT_COLORS  0x01  // payload: RED, GRN, BLU for each of the 4 segments; switches to DMODE_CUSTOM
+#define DATA_EXT_TYPE_DMODE           0x02  // payload: dmode, dsubmode, dmode_step
+#define DATA_EXT_TYPE_EFFECT          0x03  // payload: dsubmode, effect step period in milliseconds (0 = effect default)
+#define DATA_EXT_TYPE_SCRIPT          0x04  // payload: offset into the EEPROM script area, then up to 11 bytes of script to store there
+#define DATA_EXT_TYPE_CALIBRATION     0x05  // payload: offset into the color calibration block (see calib.h), then up to 11 bytes to store there
+
 // DATA RECEPTION CIRCLE BUFFER
 #define DATA_CBUF_LEN         8     // length of the circle buffer used to store bits sent from the hilt; should be some power of 2
 #define DATA_BIT_MAX_LEN      5000  // maximum length of time, in microseconds, that data pin should be held active to indicate a bit; 5000uS was an arbitrary choice, it's less than the length of the preamble (12ms), but more than the length of a '1' bit (1.2ms)
 #define DATA_BIT_ONE_MAX_LEN  1800  // maximum length of time, in microseconds, that data pins should be held active to indicate a bit value of ONE; any longer and it's a bit value of ZERO
+#define DATA_RUNT_MAX_LEN     400   // an active pulse shorter than this, in microseconds, is too short to be a real bit; counted as a runt by the telemetry
+
+// DATA LINE TELEMETRY
+// uncomment DATA_TELEMETRY_ENABLED to keep a set of counters on the health of the data line.
+// counters saturate at 0xFFFF rather than roll over. they are reported over serial (if enabled) when
+// the blade goes to sleep. uncomment DATA_TELEMETRY_EEPROM_ENABLED as well to accumulate the counters
+// in EEPROM across sleeps and power cycles; that needs a part with 256 bytes of EEPROM (e.g. ATtiny1606),
+// the 128 bytes of an ATtiny806 are taken by settings, scripts and calibration.
+//#define DATA_TELEMETRY_ENABLED
+//#define DATA_TELEMETRY_EEPROM_ENABLED
+
+#if defined(DATA_TELEMETRY_EEPROM_ENABLED) && !defined(DATA_TELEMETRY_ENABLED)
+  #error "DATA_TELEMETRY_EEPROM_ENABLED requires DATA_TELEMETRY_ENABLED"
+#endif
+
+// saturating increment of a 16-bit telemetry counter
+#ifdef DATA_TELEMETRY_ENABLED
+  #define DATA_TELEMETRY_INC(X) do { if ((X) != 0xFFFF) { (X)++; } } while (0)
+#else
+  #define DATA_TELEMETRY_INC(X) do { } while (0)
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,11 +103,48 @@ extern "C" {
 // GLOBAL: data_cmd - store the current command from the data line
 extern uint8_t data_cmd;
 
+// GLOBAL: data_cmd_partial - high nibble of the command being received once its first 4 bits are in; 0 otherwise
+extern uint8_t data_cmd_partial;
+
 struct data_cbuf_struct {
   uint8_t state;            // data pin state
   uint32_t state_time;      // time the state was recorded
 };
 
+struct data_ext_frame_struct {
+  uint8_t len;                        // payload length
+  uint8_t type;                       // frame type, one of DATA_EXT_TYPE_*
+  uint8_t payload[DATA_EXT_MAX_LEN];  // frame payload
+};
+
+// GLOBAL: data_ext_ready - set when data_ext_frame holds a complete frame; cleared by command_handler() once processed
+extern uint8_t data_ext_ready;
+
+// GLOBAL: data_ext_frame - the last complete extended command frame
+extern struct data_ext_frame_struct data_ext_frame;
+
+struct data_telemetry_struct {
+  uint16_t edges;           // data pin state changes seen by the ISR
+  uint16_t overruns;        // state changes lost because cbuf was full
+  uint16_t runts;           // active pulses shorter than DATA_RUNT_MAX_LEN
+  uint16_t preambles;       // active pulses longer than DATA_BIT_MAX_LEN
+  uint16_t aborted;         // preambles that arrived in the middle of a command
+  uint16_t frames;          // complete 8-bit commands decoded
+  uint16_t dropped;         // commands overwritten before command_handler() picked them up, and extended frames that arrived while the last one was still held
+  uint16_t multi_mode;      // commands processed while PWM was in multi-color mode
+  uint16_t cmd[16];         // commands processed by command_handler(), indexed by the high nibble of the command
+};
+
+#ifdef DATA_TELEMETRY_ENABLED
+// GLOBAL: data_telemetry - data line health counters
+extern volatile struct data_telemetry_struct data_telemetry;
+
+#ifdef DEBUG_SERIAL_ENABLED
+// dump the telemetry counters to serial
+void data_telemetry_dump(void);
+#endif
+#endif
+
 // setup the DATA pin for reception of commands from the hilt
 void data_setup(void);
 
@@ -58,6 +154,9 @@ void disable_data_pin(void);
 // enable the data pin
 void enable_data_pin(void);
 
+// prepare the decoder for the MCU going into power-down sleep
+void data_sleep(void);
+
 // manage commands coming from hilt
 void data_handler(void);
 
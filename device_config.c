@@ -20,6 +20,8 @@
 #include "blade_state.h"
 #include "dmode_handler.h"
 #include "pwm.h"
+#include "latency.h"
+#include "rng.h"
 
 // set the FUSES for the ATtiny806/1606; the default fuse values are used
 // this exists so fuse data can be extracted from the compiled program and 
@@ -42,6 +44,7 @@ FUSES = {
 #endif
 
 uint8_t switch_config = 0;
+uint32_t wake_time = 0;
 
 void device_setup(void) {
 
@@ -82,9 +85,12 @@ void device_setup(void) {
 
     // report VCC
     serial_sendString("VCC: ");
-    dtostrf(measure_vcc(), 4, 2, serial_buf);
+    snprintf(serial_buf, SERIAL_BUF_LEN, "%u", measure_vcc());
     serial_sendString(serial_buf);
-    serial_sendString("V\r\n\r\n");
+    serial_sendString("mV\r\n\r\n");
+
+    // report RAM usage
+    ram_report();
   #endif
 
   // seed the RNG
@@ -130,12 +136,12 @@ void srand_init(void) {
   ADC0.CTRLA = 1 << ADC_ENABLE_bp;                      // enable ADC
   ADC0.CTRLB = ADC_SAMPNUM_ACC64_gc;                    // accumulate 64 samples per conversion
   ADC0.CTRLC = 1 << ADC_SAMPCAP_bp                      // reduced sampling capacitance (recommended for voltages over 1V)
-             | ADC_REFSEL_VDDREF_gc                     // use VDD as a voltage reference; CRITICAL when sampling unused pin for srand seeding
+             | ADC_REFSEL_VDDREF_gc                     // use VDD as a voltage reference; CRITICAL when sampling unused pin for RNG seeding
              | ADC_PRESC_DIV32_gc;                      // prescale the ADC clock (is this necessary? probably not)
   ADC0.CTRLD = ADC_INITDLY_DLY256_gc;                   // delay initialization 256 CLK_ADC cycles (let things settle down)
   ADC0.MUXPOS = ADC_MUXPOS_AIN3_gc ;                    // connect AIN3 (PA3; an unused pin) to the ADC
 
-  // srand() takes an unsigned integer (16-bit) value.  the ADC sample returns a 10-bit value.
+  // rng_seed() takes a 16-bit value.  the ADC sample returns a 10-bit value.
   //
   // this loop takes 16 sample results (each result comprised of 64 samples), extracting the 
   // LSB of each sample and shifting it into seed
@@ -149,7 +155,19 @@ void srand_init(void) {
   ADC0.CTRLA &= ~(1 << ADC_ENABLE_bp);                  // disable ADC
   ADC0.MUXPOS = 0;                                      // disconnect pins from ADC
 
-  srand(seed);                                          // seed the RNG
+  rng_seed(seed);                                       // seed the RNG
+}
+
+#ifdef DEBUG_SERIAL_ENABLED
+// symbols provided by the linker; the start of static data and the end of .bss
+extern char __data_start;
+extern char __bss_end;
+
+// report RAM used by static variables and what's left over for the stack
+void ram_report(void) {
+  snprintf(serial_buf, SERIAL_BUF_LEN, "RAM: %u bytes static, %u bytes free\r\n\r\n",
+    (uint16_t)(&__bss_end - &__data_start), (uint16_t)(SP - (uint16_t)&__bss_end));
+  serial_sendString(serial_buf);
 }
 
 void srand_sample_report(void) {
@@ -160,11 +178,12 @@ void srand_sample_report(void) {
     if (i>0 && i%10 == 0) {
       serial_sendString("\r\n");
     }
-    snprintf(serial_buf, SERIAL_BUF_LEN, "  %04X", rand());  // RAND_MAX = 0x7FFF
+    snprintf(serial_buf, SERIAL_BUF_LEN, "  %04X", rng16());
     serial_sendString(serial_buf);
   }
   serial_sendString("\r\n\r\n");
 }
+#endif
 
 void blade_power_on(void) {
   LDO_PORT.OUTSET = LDO_PIN_bm;
@@ -185,17 +204,32 @@ void sleep_handler(void) {
     if (last_state != blade.state) {
       last_off_time = millis();
 
+      // store the blade state right away so it isn't lost if the blade is pulled before it goes to sleep.
+      // each save goes to the next record of the blade state log, spreading the wear over the whole log,
+      // and nothing is written if the state hasn't changed since the last save. parts whose log holds a
+      // single record would rewrite the same cells every time, so they only save when going to sleep
+      #ifdef EEPROM_LOG_WEAR_LEVELING
+        eeprom_store_state();
+      #endif
+
     // has it been off for more than X seconds?
     } else if ((millis() - last_off_time) > OFF_TO_SLEEP_TIME) {
 
-      // i want to minimize EEPROM writes; a write after EVERY dmode or dsubmode change is not desireable.
-      // so i will store blade state to eeprom when blade is going to sleep. this means blade has been off for
-      // a significant amount of time and it's unlikely the user is spamming dmode/dsubmode changes
+      // store the blade state again in case it changed while the blade was off (e.g. an extended command)
       eeprom_store_state();
+      #ifdef DATA_TELEMETRY_EEPROM_ENABLED
+        eeprom_store_telemetry();
+      #endif
 
       // put the blade to sleep.
       // no further code is executed after sleep_cpu() until the blade wakes up
       #ifdef DEBUG_SERIAL_ENABLED
+        #ifdef DATA_TELEMETRY_ENABLED
+          data_telemetry_dump();
+        #endif
+        #ifdef LATENCY_TRACE_ENABLED
+          latency_dump();
+        #endif
         serial_sendString("Going to sleep.\r\n\r\n");
         last_off_time = millis() + 100;
         while (millis() < last_off_time) {
@@ -203,11 +237,21 @@ void sleep_handler(void) {
         }
       #endif
 
+      // finish writing to EEPROM before the clock stops
+      eeprom_commit_flush();
+
+      // a speculative ignite whose command never finished must not leave the LDO on while asleep
+      #ifdef DATA_SPECULATIVE_IGNITE
+        speculative_ignite_cancel();
+      #endif
+
       // put the microcontroller to sleep; no further code is executed after sleep_cpu() until the mcu wakes up
+      data_sleep();
       sleep_cpu();
 
       // restart the power off timer
       last_off_time = millis();
+      wake_time = last_off_time;
 
       // did the switch config change while the blade was asleep?
       //
@@ -279,9 +323,9 @@ uint8_t reset_handler(void) {
 }
 
 // http://ww1.microchip.com/downloads/en/AppNotes/00002447A.pdf
-float measure_vcc(void) {
+uint16_t measure_vcc(void) {
 
-  float vcc_value = 0;
+  uint16_t vcc_value = 0;
   uint8_t old_vref_ctrla = VREF.CTRLA;
 
   // select 1.1V reference voltage for ADC0
@@ -305,9 +349,9 @@ float measure_vcc(void) {
   // wait for results
   while (!(ADC0.INTFLAGS & (1 << ADC_RESRDY_bp) )) {}
 
-  // calculate Vcc: (ref voltage * max ADC value * # of samples) / ADC result
+  // calculate Vcc in millivolts: (ref voltage * max ADC value * # of samples) / ADC result
   // 10-bit ADC, thus max value is 0x03FF
-  vcc_value = (1.1 * 0x400 * 64) / ADC0.RES;
+  vcc_value = (uint16_t)((1100UL * 0x400 * 64) / ADC0.RES);
 
   VREF.CTRLA = old_vref_ctrla;          // restore original VREF selection
   ADC0.CTRLA &= ~(1 << ADC_ENABLE_bp);  // disable ADC
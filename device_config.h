@@ -31,6 +31,9 @@ extern "C" {
 // global used to keep track of the hardware switches attached to the blade
 extern uint8_t switch_config;
 
+// time, in milliseconds, the MCU last woke from sleep; 0 once the wake has been reported
+extern uint32_t wake_time;
+
 // perform MCU and program initialization
 void device_setup(void);
 
@@ -38,18 +41,23 @@ void device_setup(void);
 // the random number generator. In theory.
 void srand_init(void);
 
-// sample rand() 100 times and write the output to serial for purpose of 
+// sample rng16() 100 times and write the output to serial for purpose of 
 // auditing seeding of RNG via srand_init()
+#ifdef DEBUG_SERIAL_ENABLED
 void srand_sample_report(void);
 
+// report static RAM usage and the RAM left for the stack to serial
+void ram_report(void);
+#endif
+
 // enable the LDO that powers the blade's LEDs
 void blade_power_on(void);
 
 // disable the LDO that powers the blade's LEDs
 void blade_power_off(void);
 
-// get MCU Vcc
-float measure_vcc(void);
+// get MCU Vcc in millivolts
+uint16_t measure_vcc(void);
 
 // initalize blade switch settings
 void switch_setup(void);
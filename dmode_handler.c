@@ -4,15 +4,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
-#include "millis.h"
+#include "frame.h"
 #include "serial.h"
 #include "blade_state.h"
 #include "dmode_handler.h"
 #include "pwm.h"
+#include "fixed.h"
+#include "rng.h"
+#include "noise.h"
+#include "motion.h"
+#include "fade.h"
+#include "script.h"
 
 // multi-color blade presets
-uint8_t blade_multi_colors[][BLADE_SEGMENTS][RGB_SIZE] = {
+const uint8_t blade_multi_colors[][BLADE_SEGMENTS][RGB_SIZE] = {
   // outlandish
   {{  0, 255,   0}, {  0,   0, 255}, {255, 255, 255}, {255,   0,   0}}, // rocket popsicle
 
@@ -32,13 +37,165 @@ uint8_t blade_multi_colors[][BLADE_SEGMENTS][RGB_SIZE] = {
   // misc
   {{192,  64,   0}, {128,  48,  32}, { 96,  16,  64}, { 48,   0,  96}}, // orange-to-purple
 };
-uint8_t blade_multi_colors_len = sizeof(blade_multi_colors) / sizeof(blade_multi_colors[0]);
-
-// color picker step lookup table 
-uint8_t dcp_step_table[DCP_STEP_TABLE_MAX];
-uint8_t dcp_max_steps = 0;
+#define DMULTI_PRESETS (sizeof(blade_multi_colors) / sizeof(blade_multi_colors[0]))
+const uint8_t blade_multi_colors_len = DMULTI_PRESETS;
+
+// custom segment colors; set by an extended command frame, stored in EEPROM
+uint8_t custom_segment_colors[BLADE_SEGMENTS][RGB_SIZE] = {{0,0,0},{0,0,0},{0,0,0},{0,0,0}};
+
+// effect step period override; set by an extended command frame
+uint8_t dmode_effect_period = 0;
+
+// DCP STEPPING
+//
+// the color picker steps through colors DCP_STEP(k) colors at a time, where k is blade.dsubmode
+// modulo DCP_STEP_COUNT. the steps are the distinct values of DCP_FORMULA_SEPARATOR / n for n >= 2,
+// largest first, down to 1. for n up to the square root of the separator those values are all
+// distinct; below that every integer from DCP_FORMULA_SEPARATOR / (root + 1) down to 1 appears once.
+// plain integer versions of the DCP values are used here so they can be evaluated by #if
+#define DCP_STEP_COLORS   (DCP_MAX_COLORSPACE / DCP_BRIGHTNESS_LEVELS)  // same as DCP_COLOR_COUNT
+#define DCP_STEP_SEP      (DCP_STEP_COLORS / 3)                         // same as DCP_FORMULA_SEPARATOR
+
+#if (DCP_STEP_SEP < 2)
+#error "the color picker needs a DCP_FORMULA_SEPARATOR of at least 2; DCP_BRIGHTNESS_LEVELS must be 3 to 42"
+#elif (DCP_STEP_SEP >= 81)
+#define DCP_STEP_ROOT     9
+#elif (DCP_STEP_SEP >= 64)
+#define DCP_STEP_ROOT     8
+#elif (DCP_STEP_SEP >= 49)
+#define DCP_STEP_ROOT     7
+#elif (DCP_STEP_SEP >= 36)
+#define DCP_STEP_ROOT     6
+#elif (DCP_STEP_SEP >= 25)
+#define DCP_STEP_ROOT     5
+#elif (DCP_STEP_SEP >= 16)
+#define DCP_STEP_ROOT     4
+#elif (DCP_STEP_SEP >= 9)
+#define DCP_STEP_ROOT     3
+#elif (DCP_STEP_SEP >= 4)
+#define DCP_STEP_ROOT     2
+#else
+#define DCP_STEP_ROOT     1
+#endif
+
+#if ((DCP_STEP_ROOT - 1) + DCP_STEP_SEP / (DCP_STEP_ROOT + 1) > DCP_STEP_TABLE_MAX)
+#define DCP_STEP_COUNT    DCP_STEP_TABLE_MAX
+#else
+#define DCP_STEP_COUNT    ((DCP_STEP_ROOT - 1) + DCP_STEP_SEP / (DCP_STEP_ROOT + 1))
+#endif
+
+#define DCP_STEP(k)       ((k) < DCP_STEP_ROOT - 1 ? DCP_STEP_SEP / ((k) + 2) : DCP_STEP_SEP / (DCP_STEP_ROOT + 1) - ((k) - (DCP_STEP_ROOT - 1)))
+
+// the color that follows color c when stepping by DCP_STEP(k). a step that lands within half a step
+// of the next color formula moves on to that formula so the picker always lands on pure red, green
+// and blue; a step that overshoots into the next formula backs up to its start; a step that runs
+// past the end of the color space wraps back to color 0 of the same brightness level
+#define DCP_CV(x)         ((x) % DCP_STEP_COLORS)
+#define DCP_FV(x)         (DCP_CV(x) % DCP_STEP_SEP)
+#define DCP_NEXT_1(k, c)  ((c) + DCP_STEP(k))
+#define DCP_NEXT_2(k, c)  (DCP_NEXT_1(k, c) + (DCP_STEP_SEP - DCP_FV(DCP_NEXT_1(k, c)) <= DCP_STEP(k) / 2 ? DCP_STEP_SEP - DCP_FV(DCP_NEXT_1(k, c)) : 0))
+#define DCP_NEXT_3(k, c)  (DCP_CV(DCP_NEXT_2(k, c)) >= (DCP_STEP_SEP * 3) - DCP_STEP(k) / 2 ? DCP_NEXT_2(k, c) + DCP_STEP_COLORS - DCP_CV(DCP_NEXT_2(k, c)) : \
+                          (DCP_FV(DCP_NEXT_2(k, c)) > 0 && DCP_FV(DCP_NEXT_2(k, c)) < DCP_STEP(k)) ? DCP_NEXT_2(k, c) - DCP_FV(DCP_NEXT_2(k, c)) : DCP_NEXT_2(k, c))
+#define DCP_NEXT(k, c)    (DCP_NEXT_3(k, c) != 0 && DCP_CV(DCP_NEXT_3(k, c)) < DCP_STEP(k) ? DCP_NEXT_3(k, c) - DCP_STEP_COLORS : DCP_NEXT_3(k, c))
+
+// repeat a table entry macro for 2^n consecutive indexes starting at i; each entry is followed by a comma
+#define DCP_COLS_1(k, i)    DCP_NEXT(k, i),
+#define DCP_COLS_2(k, i)    DCP_COLS_1(k, i)  DCP_COLS_1(k, (i) + 1)
+#define DCP_COLS_4(k, i)    DCP_COLS_2(k, i)  DCP_COLS_2(k, (i) + 2)
+#define DCP_COLS_8(k, i)    DCP_COLS_4(k, i)  DCP_COLS_4(k, (i) + 4)
+#define DCP_COLS_16(k, i)   DCP_COLS_8(k, i)  DCP_COLS_8(k, (i) + 8)
+#define DCP_COLS_32(k, i)   DCP_COLS_16(k, i) DCP_COLS_16(k, (i) + 16)
+#define DCP_COLS_64(k, i)   DCP_COLS_32(k, i) DCP_COLS_32(k, (i) + 32)
+#define DCP_COLS_128(k, i)  DCP_COLS_64(k, i) DCP_COLS_64(k, (i) + 64)
+#define DCP_ROWS_1(i)       { DCP_COLS(i) },
+#define DCP_ROWS_2(i)       DCP_ROWS_1(i)     DCP_ROWS_1((i) + 1)
+#define DCP_ROWS_4(i)       DCP_ROWS_2(i)     DCP_ROWS_2((i) + 2)
+#define DCP_ROWS_8(i)       DCP_ROWS_4(i)     DCP_ROWS_4((i) + 4)
+#define DCP_ROWS_16(i)      DCP_ROWS_8(i)     DCP_ROWS_8((i) + 8)
+
+// build a row of exactly DCP_STEP_COLORS entries, and exactly DCP_STEP_COUNT rows, one power of 2 at a time
+#if (DCP_STEP_COLORS & 1)
+#define DCP_COLS_B0(k)      DCP_COLS_1(k, 0)
+#else
+#define DCP_COLS_B0(k)
+#endif
+#if (DCP_STEP_COLORS & 2)
+#define DCP_COLS_B1(k)      DCP_COLS_2(k, DCP_STEP_COLORS & 1)
+#else
+#define DCP_COLS_B1(k)
+#endif
+#if (DCP_STEP_COLORS & 4)
+#define DCP_COLS_B2(k)      DCP_COLS_4(k, DCP_STEP_COLORS & 3)
+#else
+#define DCP_COLS_B2(k)
+#endif
+#if (DCP_STEP_COLORS & 8)
+#define DCP_COLS_B3(k)      DCP_COLS_8(k, DCP_STEP_COLORS & 7)
+#else
+#define DCP_COLS_B3(k)
+#endif
+#if (DCP_STEP_COLORS & 16)
+#define DCP_COLS_B4(k)      DCP_COLS_16(k, DCP_STEP_COLORS & 15)
+#else
+#define DCP_COLS_B4(k)
+#endif
+#if (DCP_STEP_COLORS & 32)
+#define DCP_COLS_B5(k)      DCP_COLS_32(k, DCP_STEP_COLORS & 31)
+#else
+#define DCP_COLS_B5(k)
+#endif
+#if (DCP_STEP_COLORS & 64)
+#define DCP_COLS_B6(k)      DCP_COLS_64(k, DCP_STEP_COLORS & 63)
+#else
+#define DCP_COLS_B6(k)
+#endif
+#if (DCP_STEP_COLORS & 128)
+#define DCP_COLS_B7(k)      DCP_COLS_128(k, DCP_STEP_COLORS & 127)
+#else
+#define DCP_COLS_B7(k)
+#endif
+#define DCP_COLS(k)         DCP_COLS_B0(k) DCP_COLS_B1(k) DCP_COLS_B2(k) DCP_COLS_B3(k) DCP_COLS_B4(k) DCP_COLS_B5(k) DCP_COLS_B6(k) DCP_COLS_B7(k)
+
+#if (DCP_STEP_COUNT & 1)
+#define DCP_ROWS_B0         DCP_ROWS_1(0)
+#else
+#define DCP_ROWS_B0
+#endif
+#if (DCP_STEP_COUNT & 2)
+#define DCP_ROWS_B1         DCP_ROWS_2(DCP_STEP_COUNT & 1)
+#else
+#define DCP_ROWS_B1
+#endif
+#if (DCP_STEP_COUNT & 4)
+#define DCP_ROWS_B2         DCP_ROWS_4(DCP_STEP_COUNT & 3)
+#else
+#define DCP_ROWS_B2
+#endif
+#if (DCP_STEP_COUNT & 8)
+#define DCP_ROWS_B3         DCP_ROWS_8(DCP_STEP_COUNT & 7)
+#else
+#define DCP_ROWS_B3
+#endif
+#if (DCP_STEP_COUNT & 16)
+#define DCP_ROWS_B4         DCP_ROWS_16(DCP_STEP_COUNT & 15)
+#else
+#define DCP_ROWS_B4
+#endif
+
+// the table is DCP_STEP_COUNT * DCP_STEP_COLORS bytes, which grows quickly as DCP_BRIGHTNESS_LEVELS
+// drops: 306 bytes at 5 levels, 680 at 3, 1397 at 2 and 4080 at 1, half the flash of an ATtiny806
+#if (DCP_STEP_COUNT * DCP_STEP_COLORS > DCP_NEXT_TABLE_MAX)
+#error "the color picker's next-color table is larger than DCP_NEXT_TABLE_MAX; DCP_BRIGHTNESS_LEVELS must be 3 to 42"
+#endif
+
+// dcp_next_color[k][c] is the color that follows color c when the step size is DCP_STEP(k).
+// colors are relative to the start of the current brightness level
+const uint8_t dcp_next_color[DCP_STEP_COUNT][DCP_STEP_COLORS] = {
+  DCP_ROWS_B0 DCP_ROWS_B1 DCP_ROWS_B2 DCP_ROWS_B3 DCP_ROWS_B4
+};
 
-// dump the contents of dcp_step_table[] to aid in validation/debugging
+#ifdef DEBUG_SERIAL_ENABLED
+// dump the color picker step sizes to aid in validation/debugging
 void dcp_step_table_dump(void) {
   uint8_t i;
 
@@ -55,253 +212,791 @@ void dcp_step_table_dump(void) {
   snprintf(serial_buf, SERIAL_BUF_LEN, "DCP_MAX_STEP:          %d\r\n", DCP_MAX_STEP);
   serial_sendString(serial_buf);
 
-  // dump the step table contents
+  // dump the step sizes
   serial_sendString("\r\n");
-  serial_sendString("DCP_STEP_TABLE[] Contents:\r\n");
-  for (i=0;i<dcp_max_steps;i++) {
-    snprintf(serial_buf, SERIAL_BUF_LEN, "  dsubmode: %d, dcp_step %d\r\n", i, dcp_step_table[i]);
+  serial_sendString("DCP_STEP() Values:\r\n");
+  for (i=0;i<DCP_STEP_COUNT;i++) {
+    snprintf(serial_buf, SERIAL_BUF_LEN, "  dsubmode: %d, dcp_step %d\r\n", i, DCP_STEP(i));
     serial_sendString(serial_buf);
   }
   serial_sendString("\r\n");
 }
+#endif
+
+// DCP PALETTE
+//
+// the color picker's RGB values for every wheel value (0-255) are generated at compile time by the
+// macros below and stored in dcp_palette[]. change the DCP_* defines in dmode_handler.h and the table
+// follows. the formulas are based on the wheel() function found here:
+// https://learn.adafruit.com/multi-tasking-the-arduino-part-3/utility-functions
+//
+// a wheel value is made up of a color (0 to DCP_COLOR_COUNT) and a brightness level. each of the
+// three color formulas covers DCP_FORMULA_SEPARATOR colors and ramps one component up while
+// another ramps down. brightness levels above DCP_MIDDLE_LEVEL blend toward the stock white blade
+// color by (level / DCP_BRIGHTNESS_LEVELS)^2, levels below it darken the color by
+// ((level + 1) / (DCP_MIDDLE_LEVEL + 1))^2. wheel value 255 is always white
+#define DCP_COLOR(w)        ((w) % DCP_COLOR_COUNT)
+#define DCP_LEVEL(w)        ((w) / DCP_COLOR_COUNT)
+#define DCP_RAMP(c)         (((c) * 3 * DCP_BRIGHTNESS_LEVELS) & 0xFF)
+#define DCP_FORMULA(w)      (DCP_COLOR(w) < DCP_FORMULA_SEPARATOR ? 0 : DCP_COLOR(w) < (2 * DCP_FORMULA_SEPARATOR) ? 1 : 2)
+#define DCP_OFFSET(w)       (DCP_COLOR(w) - (DCP_FORMULA(w) * DCP_FORMULA_SEPARATOR))
+
+// each component's value before brightness is applied; f is the formula the component ramps up in
+#define DCP_BASE(w, f)      (DCP_FORMULA(w) == (f) ? DCP_RAMP(DCP_OFFSET(w)) : DCP_FORMULA(w) == ((f) + 1) % 3 ? 255 - DCP_RAMP(DCP_OFFSET(w)) : 0)
+
+// apply brightness level l to component value x; white is the component's value in the stock white blade color
+#if (DCP_BRIGHTNESS_LEVELS > 1)
+#define DCP_SHADE(x, white, l) ( \
+  (l) > DCP_MIDDLE_LEVEL ? (((x) - (((x) - (white)) * (l) * (l)) / (DCP_BRIGHTNESS_LEVELS * DCP_BRIGHTNESS_LEVELS)) & 0xFF) : \
+  (l) < DCP_MIDDLE_LEVEL ? (((x) * ((l) + 1) * ((l) + 1)) / ((DCP_MIDDLE_LEVEL + 1) * (DCP_MIDDLE_LEVEL + 1))) : (x))
+#else
+#define DCP_SHADE(x, white, l) (x)
+#endif
+
+#define DCP_RED(w)    ((w) == 255 ? STOCK_BLADE_WHITE_RED : DCP_SHADE(DCP_BASE(w, 2), STOCK_BLADE_WHITE_RED, DCP_LEVEL(w)))
+#define DCP_GRN(w)    ((w) == 255 ? STOCK_BLADE_WHITE_GRN : DCP_SHADE(DCP_BASE(w, 0), STOCK_BLADE_WHITE_GRN, DCP_LEVEL(w)))
+#define DCP_BLU(w)    ((w) == 255 ? STOCK_BLADE_WHITE_BLU : DCP_SHADE(DCP_BASE(w, 1), STOCK_BLADE_WHITE_BLU, DCP_LEVEL(w)))
+#define DCP_ENTRY(w)  { DCP_RED(w), DCP_GRN(w), DCP_BLU(w) }
+#define DCP_ROW(w)    DCP_ENTRY((w) +  0), DCP_ENTRY((w) +  1), DCP_ENTRY((w) +  2), DCP_ENTRY((w) +  3), \
+                      DCP_ENTRY((w) +  4), DCP_ENTRY((w) +  5), DCP_ENTRY((w) +  6), DCP_ENTRY((w) +  7), \
+                      DCP_ENTRY((w) +  8), DCP_ENTRY((w) +  9), DCP_ENTRY((w) + 10), DCP_ENTRY((w) + 11), \
+                      DCP_ENTRY((w) + 12), DCP_ENTRY((w) + 13), DCP_ENTRY((w) + 14), DCP_ENTRY((w) + 15)
+
+const uint8_t dcp_palette[256][RGB_SIZE] = {
+  DCP_ROW(  0), DCP_ROW( 16), DCP_ROW( 32), DCP_ROW( 48),
+  DCP_ROW( 64), DCP_ROW( 80), DCP_ROW( 96), DCP_ROW(112),
+  DCP_ROW(128), DCP_ROW(144), DCP_ROW(160), DCP_ROW(176),
+  DCP_ROW(192), DCP_ROW(208), DCP_ROW(224), DCP_ROW(240)
+};
 
-// precalculate the size of steps to take between colors when cycling through
-// colors in color picker mode for a given value of blade.dsubmode
-void precalc_dcp_step_table(void) {
-  uint8_t prev_step = 255;
-  uint8_t dsubmode_index = 0;
-  uint8_t step;
-
-  while(1) {
-    step = DCP_FORMULA_SEPARATOR / (2 + dsubmode_index);
-    if (step != prev_step) {
-      dcp_step_table[dcp_max_steps++] = step;
-      prev_step = step;
-    }
-    if (step == 1 || dcp_max_steps >= DCP_STEP_TABLE_MAX) {
-      break;
-    }
-    dsubmode_index++;
-  }
+// set a segment to the color picker color for the given wheel value
+void set_dcp_segment_color(uint8_t segment, uint8_t wheel_value) {
+  set_custom_segment_color(segment, dcp_palette[wheel_value][RED_IDX], dcp_palette[wheel_value][GRN_IDX], dcp_palette[wheel_value][BLU_IDX]);
 
   #ifdef DEBUG_SERIAL_ENABLED
-    dcp_step_table_dump();
+  if (segment == 0) {
+    snprintf(serial_buf, SERIAL_BUF_LEN, "  [wheel:%3d] R:%3d G:%3d B:%3d\r\n", wheel_value, dcp_palette[wheel_value][RED_IDX], dcp_palette[wheel_value][GRN_IDX], dcp_palette[wheel_value][BLU_IDX]);
+    serial_sendString(serial_buf);
+  }
   #endif
 }
 
-// similar to set_segment_color_by_wheel with the extra feature of
-// generating not just color, but levels of brightness based on BRIGHTNESS_LEVELS
-void set_dcp_segment_color(uint8_t segment, uint8_t wheel_value) {
+// set the whole blade to a color picker color; the color picker's equivalent of set_blade_color_hsv()
+void set_dcp_color(uint8_t color) {
+  uint8_t i;
 
-  uint8_t red, green, blue, color, brightness;
+  // calculate color for first segment
+  set_dcp_segment_color(0, color);
+  
+  // copy values from first segment to other 3 segments
+  for (i=1;i<3;i++) {
+    segment_color[i][RED_IDX] = segment_color[0][RED_IDX];
+    segment_color[i][GRN_IDX] = segment_color[0][GRN_IDX];
+    segment_color[i][BLU_IDX] = segment_color[0][BLU_IDX];
+  }
+}
 
-  // special case, set blade to WHITE
-  if (wheel_value == 255) {
-    red   = stock_blade_colors[STOCK_BLADE_COLOR_WHITE][RED_IDX];
-    green = stock_blade_colors[STOCK_BLADE_COLOR_WHITE][GRN_IDX];
-    blue  = stock_blade_colors[STOCK_BLADE_COLOR_WHITE][BLU_IDX];
-    color = 255;
-    brightness = DCP_BRIGHTNESS_LEVELS;
+void apply_custom_segment_colors(void) {
+  uint8_t i;
+  for (i=0;i<BLADE_SEGMENTS;i++) {
+    set_custom_segment_color(i, custom_segment_colors[i][RED_IDX], custom_segment_colors[i][GRN_IDX], custom_segment_colors[i][BLU_IDX]);
+  }
+}
 
-  // else, calculate color like normal
-  } else {
+// return the period, in milliseconds, an effect should wait before its next step
+uint16_t effect_period(uint16_t default_period) {
+  if (dmode_effect_period != 0) {
+    return dmode_effect_period;
+  }
+  return default_period;
+}
 
-    // separate color and brightness values from the supplied wheel value
-    color = wheel_value % DCP_COLOR_COUNT;
-    brightness = (uint8_t)(wheel_value / DCP_COLOR_COUNT);
+// EFFECT REGISTRY
+//
+// the blade's appearance comes from two effects that run side by side. the color effect is picked
+// by blade.dmode and sets segment colors; the brightness effect is picked by the color effect from
+// blade.dsubmode and sets segment brightness. each is an entry in one of the tables below, and each
+// has its own step schedule, so a brightness effect (e.g. a flicker) can run on top of any color
+// effect that chooses one (e.g. the multi-color presets).
+//
+// callbacks may be NULL. step is passed dt, the milliseconds since the effect's last step, and returns
+// the time, in milliseconds, until its next step, or 0 to wait the entry's period (which an extended
+// command can override; see effect_period()). effects that move at a rate (noise, motion, the color
+// wheels, scripts) advance by dt, so they keep their speed when the main loop runs slower than their
+// period; flickers and breathing are made of discrete steps and take one per call.
+// config reads the effect's settings from dmode_desc, which has already been updated for the new dsubmode
+struct dmode_effect_struct {
+  void (*init)(const struct dmode_effect_struct *fx);     // the effect has been selected
+  void (*config)(const struct dmode_effect_struct *fx);   // blade.dsubmode has changed; also runs after init
+  void (*clash)(const struct dmode_effect_struct *fx);    // a clash has just ended
+  uint16_t (*step)(const struct dmode_effect_struct *fx, uint16_t dt); // time to take a step
+  uint16_t period;                                        // milliseconds between steps
+  uint8_t param[BLADE_SEGMENTS];                          // effect-specific parameters
+};
 
-    // calculate the red, green, and blue components of the color based on color value.
-    //
-    // this formula is based on the wheel() function found here:
-    // https://learn.adafruit.com/multi-tasking-the-arduino-part-3/utility-functions
-    if (color < DCP_FORMULA_SEPARATOR) {
-      green = color * 3 * DCP_BRIGHTNESS_LEVELS;
-      red = ~green;
-      blue = 0;
-    } else if (color < (2 * DCP_FORMULA_SEPARATOR)) {
-      color -= DCP_FORMULA_SEPARATOR;
-      blue = color * 3 * DCP_BRIGHTNESS_LEVELS;
-      green = ~blue;
-      red = 0;
-    } else {
-      color -= (2 * DCP_FORMULA_SEPARATOR);
-      red = color * 3 * DCP_BRIGHTNESS_LEVELS;
-      blue = ~red;
-      green = 0;
+// the longest dt passed to an effect's step; the longest period an extended command can set, plus
+// as late as a step can run before effect_run() gives up catching up
+#define EFFECT_DT_MAX   (255 + FRAME_DT_MAX)
+
+// the step schedule of a running effect, in frame_time milliseconds
+struct effect_slot_struct {
+  const struct dmode_effect_struct *fx;
+  uint32_t next_step_time;    // when the effect takes its next step
+  uint32_t step_time;         // frame_time of the effect's last step
+};
+
+static struct effect_slot_struct color_slot = {NULL, 0, 0};
+static struct effect_slot_struct brightness_slot = {NULL, 0, 0};
+
+// GLOBAL: the brightness effect (DSUBMODE_*) currently running
+uint8_t dmode_brightness_effect = DSUBMODE_NORMAL;
+
+// state shared by effects
+static uint8_t step_backup = DCP_MIDDLE_LEVEL * DCP_COLOR_COUNT;  // color picker color saved while showing white
+static const uint8_t *dcp_next = dcp_next_color[0];              // color picker's next-color table for the current step size
+static uint16_t wheel_hue = 0;                                    // current hue of the color wheels
+static uint8_t wheel_rate = 10;                                   // hue the color wheels advance per millisecond
+static uint16_t noise_position = 0;
+static uint16_t motion_phase = 0;                                 // how far a motion effect is through its cycle, out of 65536
+
+// start an effect running in a slot; it takes its first step on the next frame
+static void effect_start(struct effect_slot_struct *slot, const struct dmode_effect_struct *fx) {
+  slot->fx = fx;
+  slot->next_step_time = frame_time;
+  slot->step_time = frame_time;
+  if (fx->init != NULL) {
+    fx->init(fx);
+  }
+}
+
+// take a step of the slot's effect if one is due. the next step is scheduled one period after this
+// one was due, rather than one period from now, so an effect keeps its true rate when a frame runs late.
+// returns 1 if a step was taken
+static uint8_t effect_run(struct effect_slot_struct *slot) {
+  uint32_t dt;
+  uint16_t period;
+
+  if (slot->fx == NULL || slot->fx->step == NULL || frame_dt == 0 || frame_time < slot->next_step_time) {
+    return 0;
+  }
+
+  // time since the last step; capped so an effect resumed after a long pause (e.g. the blade was off)
+  // doesn't lurch forward
+  dt = frame_time - slot->step_time;
+  if (dt > EFFECT_DT_MAX) {
+    dt = EFFECT_DT_MAX;
+  }
+  slot->step_time = frame_time;
+
+  period = slot->fx->step(slot->fx, (uint16_t)dt);
+  if (period == 0) {
+    period = effect_period(slot->fx->period);
+  }
+  slot->next_step_time += period;
+
+  // fallen too far behind to catch up (e.g. a period shorter than a frame); carry on from now
+  if (frame_time > slot->next_step_time + FRAME_DT_MAX) {
+    slot->next_step_time = frame_time;
+  }
+  return 1;
+}
+
+//
+// BRIGHTNESS EFFECTS
+//
+
+// hold every segment at param[] percent
+static uint16_t fx_static(const struct dmode_effect_struct *fx, uint16_t dt) {
+  uint8_t i;
+  for (i=0;i<BLADE_SEGMENTS;i++) {
+    set_segment_brightness(i, fx->param[i]);
+  }
+  return 0;
+}
+
+// full blade flicker
+static uint16_t fx_flicker_full(const struct dmode_effect_struct *fx, uint16_t dt) {
+  // dim blade; use segment 0 to represent the brightness of the entire blade
+  if (segment_brightness[0] > 40) {
+    segment_brightness[0] = q16_mul8(segment_brightness[0], Q16(.8));
+  }
+
+  // randomly pop blade
+  if (rng_range(3) == 0) {
+    segment_brightness[0] += (255 - segment_brightness[0]) >> 1;
+  }
+
+  // copy brightness of segment 0 to rest of segments so entire blade has same brightness
+  segment_brightness[1] = segment_brightness[0];
+  segment_brightness[2] = segment_brightness[0];
+  segment_brightness[3] = segment_brightness[0];
+  return 0;
+}
+
+// segmented flicker
+static uint16_t fx_flicker_segmented(const struct dmode_effect_struct *fx, uint16_t dt) {
+  uint8_t i;
+
+  // dim blade
+  for (i=0; i<4; i++) {
+    if (segment_brightness[i] > 40) {
+      segment_brightness[i] = q16_mul8(segment_brightness[i], Q16(.8));
     }
+  }
 
-    // no need to bother with this if DCP_BRIGHTNESS_LEVELS is set to 1
-    #if (DCP_BRIGHTNESS_LEVELS > 1)
+  // brighten a random segment
+  i = rng_range(4);
+  segment_brightness[i] += (255 - segment_brightness[i]) >> 1;
+  return 0;
+}
+
+static uint16_t fx_breathing(const struct dmode_effect_struct *fx, uint16_t dt) {
 
-    // add an amount of white to the color based on the brightness level. use the stock white blade color as a reference.
-    if (brightness > DCP_MIDDLE_LEVEL) {
-      red   -= (uint8_t)((red   - stock_blade_colors[STOCK_BLADE_COLOR_WHITE][RED_IDX]) * pow((float)brightness / DCP_BRIGHTNESS_LEVELS, 2));
-      green -= (uint8_t)((green - stock_blade_colors[STOCK_BLADE_COLOR_WHITE][GRN_IDX]) * pow((float)brightness / DCP_BRIGHTNESS_LEVELS, 2));
-      blue  -= (uint8_t)((blue  - stock_blade_colors[STOCK_BLADE_COLOR_WHITE][BLU_IDX]) * pow((float)brightness / DCP_BRIGHTNESS_LEVELS, 2));
+  // determine increment or decrement based on even/odd of segment 0
+  if (segment_brightness[0] % 2) {
 
-    // darken the color if brightness < middle_brightness_level
-    } else if (brightness < DCP_MIDDLE_LEVEL) {
-      red   = (uint8_t)(red   * pow((float)(brightness + 1)/(DCP_MIDDLE_LEVEL + 1), 2));
-      green = (uint8_t)(green * pow((float)(brightness + 1)/(DCP_MIDDLE_LEVEL + 1), 2));
-      blue  = (uint8_t)(blue  * pow((float)(brightness + 1)/(DCP_MIDDLE_LEVEL + 1), 2));
+    if (segment_brightness[0] < 12) {
+      segment_brightness[0] = 8;
+    } else {
+      segment_brightness[0] -= 4;
+    }
+  } else {
+
+    if (segment_brightness[0] > 250) {
+      segment_brightness[0] = 255;
+    } else {
+      segment_brightness[0] += 4;
     }
-    #endif
   }
 
-  // set the segment's color using the component values that have been calculated
-  set_custom_segment_color(segment, red, green, blue);
+  // propagate values
+  segment_brightness[1] = segment_brightness[0];
+  segment_brightness[2] = segment_brightness[0];
+  segment_brightness[3] = segment_brightness[0];
 
-  #ifdef DEBUG_SERIAL_ENABLED
-  if (segment == 0) {
-    snprintf(serial_buf, SERIAL_BUF_LEN, "  [wheel:%3d, color:%3d, brightness:%d] R:%3d G:%3d B:%3d\r\n", wheel_value, color, brightness, red, green, blue);
-    serial_sendString(serial_buf);
+  // pause breathing at full brightness for a bit
+  if (segment_brightness[0] == 255) {
+    return effect_period(fx->period) + 1500;
   }
-  #endif
+  return 0;
 }
 
-// similar to set_color_by_wheel except it takes BRIGHTNESS_LEVELS into consideration
-void set_dcp_color(uint8_t color) {
+static uint16_t fx_flicker_dark(const struct dmode_effect_struct *fx, uint16_t dt) {
+  // propagate flicker
+  segment_brightness[3] += ((segment_brightness[2] - segment_brightness[3]));
+  segment_brightness[2] += ((segment_brightness[1] - segment_brightness[2]));
+  // move segment 1 80% of the way toward segment 0
+  if (segment_brightness[0] >= segment_brightness[1]) {
+    segment_brightness[1] += q16_mul8(segment_brightness[0] - segment_brightness[1], Q16(.8));
+  } else {
+    segment_brightness[1] = segment_brightness[0] + q16_mul8(segment_brightness[1] - segment_brightness[0], Q16(.2));
+  }
+
+  // randomly flicker segment 0
+  if (rng_range(10) == 0) {
+    segment_brightness[0] = rng_range(60) + 20;
+
+    // otherwise brighten segment 0
+  } else {
+    segment_brightness[0] += (255 - segment_brightness[0]) >> 1;
+  }
+  return 0;
+}
+
+// only dim segment 0, then propagate
+static uint16_t fx_flicker_bright(const struct dmode_effect_struct *fx, uint16_t dt) {
   uint8_t i;
 
-  // calculate color for first segment
-  set_dcp_segment_color(0, color);
-  
-  // copy values from first segment to other 3 segments
-  for (i=1;i<3;i++) {
-    segment_color[i][RED_IDX] = segment_color[0][RED_IDX];
-    segment_color[i][GRN_IDX] = segment_color[0][GRN_IDX];
-    segment_color[i][BLU_IDX] = segment_color[0][BLU_IDX];
+  // propagate flicker
+  for (i = 3; i > 0; i--) {
+    segment_brightness[i] += ((segment_brightness[i-1] - segment_brightness[i]));
+  }
+
+  // randomly flicker segment 0
+  if (rng_range(5) == 0) {
+    segment_brightness[0] += rng_range(255 - segment_brightness[0]);
+
+  // otherwise dim segment 0
+  } else if (segment_brightness[0] > 20) {
+    segment_brightness[0] = q16_mul8(segment_brightness[0], Q16(.8));
   }
+
+  //as first segment gets dimmer the chance of a flicker increases
+  //if (random(8 - (segment_brightness[0]/32)) == 0) {
+  return 0;
 }
 
-void dmode_handler(void) {
-  static uint8_t last_dmode = 0;
-  static uint8_t last_dsubmode = 0;
-  static uint8_t last_blade_state = 0;
-  static uint32_t next_step_time = 0;
-  static uint8_t step_backup = DCP_MIDDLE_LEVEL * DCP_COLOR_COUNT;
+// segment 0 flickers, other segments are some % of segment 0
+static uint16_t fx_flicker_gradient(const struct dmode_effect_struct *fx, uint16_t dt) {
+
+  // propagate flicker
+  segment_brightness[1] = q16_mul8(segment_brightness[0], Q16(.7));
+  segment_brightness[2] = segment_brightness[0] >> 1;
+  segment_brightness[3] = q16_mul8(segment_brightness[0], Q16(.3));
+
+  // flicker at random
+  if (rng_range(5) == 0) {
+    segment_brightness[0] = 255;
+
+    // or dim
+  } else if (segment_brightness[0] > 40) {
+    segment_brightness[0] = q16_mul8(segment_brightness[0], Q16(.8));
+  }
+  return 0;
+}
+
+// unstable crystal; every segment wanders quickly and independently between dim and full brightness
+static uint16_t fx_flicker_unstable(const struct dmode_effect_struct *fx, uint16_t dt) {
   uint8_t i;
-  uint8_t dcp_step;
-  uint8_t dcp_color_value;
-  uint8_t dcp_formula_value;
-  uint8_t dcp_brightness = 0;
 
-  // one-time initialization of pdcp-step_table[];
-  // probably should call this from some other function (setup?), but as it's just for dmode and
-  // i want to keep dmode stuff together, it's here.
-  if (dcp_max_steps == 0) {
-    precalc_dcp_step_table();
+  noise_position += dt * 5 / 2;             // 2.5 noise steps per millisecond
+  for (i = 0; i < BLADE_SEGMENTS; i++) {
+    segment_brightness[i] = 96 + q16_mul8(noise8_fbm(noise_position + (i * NOISE_SEGMENT_PHASE)), Q16(.625));
   }
+  return 0;
+}
+
+// fire; a slower flame whose dips grow deeper toward the tip of the blade
+static uint16_t fx_flicker_fire(const struct dmode_effect_struct *fx, uint16_t dt) {
+  uint8_t i;
+
+  noise_position += dt;                     // 1 noise step per millisecond
+  for (i = 0; i < BLADE_SEGMENTS; i++) {
+    segment_brightness[i] = 255 - q16_mul8(noise8_fbm(noise_position + (i * NOISE_SEGMENT_PHASE)), Q16(.4) + (i * Q16(.15)));
+  }
+  return 0;
+}
+
+// MOTION EFFECTS
+//
+// a light moves along a dimmed blade at frame rate, positioned between segments (see motion.h).
+// param[0] is the brightness of the blade behind the light, param[1] the brightness the light adds
+// to it, and param[2] how far motion_phase advances each millisecond
+
+// fill the blade with the background brightness and advance motion_phase by dt milliseconds
+static void motion_step(const struct dmode_effect_struct *fx, uint16_t dt) {
+  uint8_t i;
 
-  // check for state in blade changes
-  if (last_blade_state != blade.state) {
+  for (i=0;i<BLADE_SEGMENTS;i++) {
+    segment_brightness[i] = fx->param[0];
+  }
+  motion_phase += dt * fx->param[2];
+}
 
-    // coming out of a clash
-    if ((last_blade_state & 0xF0) == BLADE_STATE_CLASH && (blade.state & 0xF0) == BLADE_STATE_ON) {
+// a light sweeping back and forth between the base and the tip of the blade
+static uint16_t fx_scanner(const struct dmode_effect_struct *fx, uint16_t dt) {
+  uint16_t sweep;
 
-      // which dmode are we in?
-      switch (blade.dmode) {
+  motion_step(fx, dt);
 
-        // color picker mode; allow clash to trigger manual color change
-        case DMODE_COLOR_PICKER:
-          next_step_time = millis() + 4000;      // pause auto-picker briefly after brightness change
+  // fold the phase into a triangle wave from 0 up to 0x7FFF and back down
+  sweep = (motion_phase & 0x8000) ? ~motion_phase : motion_phase;
+  motion_light(segment_brightness, MOTION_POS(0) + (uint16_t)(((uint32_t)sweep * (MOTION_POS(BLADE_SEGMENTS - 1) - MOTION_POS(0))) >> 15), fx->param[1]);
+  return 0;
+}
 
-          // stepping out of white, restore stored dmode_step value
-          if (blade.dmode_step == 255) {
-            blade.dmode_step = step_backup;
+// pulses of light rising from the base of the blade and running off the tip, one after another
+static uint16_t fx_pulse(const struct dmode_effect_struct *fx, uint16_t dt) {
+  motion_step(fx, dt);
+  motion_light(segment_brightness, (uint16_t)(((uint32_t)motion_phase * MOTION_POS_END) >> 16), fx->param[1]);
+  return 0;
+}
 
-            #ifdef DEBUG_SERIAL_ENABLED
-            snprintf(serial_buf, SERIAL_BUF_LEN, "WHITE mode ended! restored: %3d\r\n", step_backup);
-            serial_sendString(serial_buf);
-            #endif
+// brightness effects, indexed by DSUBMODE_*
+//                                           init  config clash step                   period          param
+static const struct dmode_effect_struct brightness_effects[DSUBMODE_MAX] = {
+  [DSUBMODE_NORMAL]             = {NULL, NULL, NULL, NULL,                  0,              {0}},
+  [DSUBMODE_FLICKER_FULL]       = {NULL, NULL, NULL, fx_flicker_full,       50,             {0}},
+  [DSUBMODE_FLICKER_SEGMENTED]  = {NULL, NULL, NULL, fx_flicker_segmented,  50,             {0}},
+  [DSUBMODE_FLICKER_BRIGHT]     = {NULL, NULL, NULL, fx_flicker_bright,     50,             {0}},
+  [DSUBMODE_FLICKER_DARK]       = {NULL, NULL, NULL, fx_flicker_dark,       50,             {0}},
+  [DSUBMODE_FLICKER_GRADIENT]   = {NULL, NULL, NULL, fx_flicker_gradient,   50,             {0}},
+  [DSUBMODE_BREATHING]          = {NULL, NULL, NULL, fx_breathing,          12,             {0}},
+  [DSUBMODE_STATIC_GRADIENT_1]  = {NULL, NULL, NULL, fx_static,             1000,           {100, 80, 60, 40}},
+  [DSUBMODE_STATIC_GRADIENT_2]  = {NULL, NULL, NULL, fx_static,             1000,           {100, 75, 50, 25}},
+  [DSUBMODE_BRIGHTNESS_66]      = {NULL, NULL, NULL, fx_static,             1000,           {66, 66, 66, 66}},
+  [DSUBMODE_BRIGHTNESS_33]      = {NULL, NULL, NULL, fx_static,             1000,           {33, 33, 33, 33}},
+  [DSUBMODE_BRIGHTNESS_10]      = {NULL, NULL, NULL, fx_static,             1000,           {10, 10, 10, 10}},
+  [DSUBMODE_FLICKER_UNSTABLE]   = {NULL, NULL, NULL, fx_flicker_unstable,   FRAME_PERIOD,   {0}},
+  [DSUBMODE_FLICKER_FIRE]       = {NULL, NULL, NULL, fx_flicker_fire,       FRAME_PERIOD,   {0}},
+  [DSUBMODE_SCANNER]            = {NULL, NULL, NULL, fx_scanner,            FRAME_PERIOD,   {40, 215, 33}},   // 2 seconds there and back
+  [DSUBMODE_PULSE]              = {NULL, NULL, NULL, fx_pulse,              FRAME_PERIOD,   {128, 127, 55}},  // a pulse every 1.2 seconds
+};
 
-            step_backup = DCP_MIDDLE_LEVEL * DCP_COLOR_COUNT;
-          } else {
+// run the given brightness effect; does nothing if it's already running
+static void brightness_effect_select(uint8_t dsubmode) {
+  if (brightness_slot.fx != &brightness_effects[dsubmode]) {
+    dmode_brightness_effect = dsubmode;
+    effect_start(&brightness_slot, &brightness_effects[dsubmode]);
+  }
+}
 
-            // increment brightness level
-            blade.dmode_step += DCP_COLOR_COUNT;
+//
+// COLOR EFFECTS
+//
 
-            // did we go past full brightness
-            if (blade.dmode_step >= (DCP_COLOR_COUNT * DCP_BRIGHTNESS_LEVELS) || (blade.dmode_step < DCP_COLOR_COUNT)) {
-              blade.dmode_step += 256 - (DCP_COLOR_COUNT * DCP_BRIGHTNESS_LEVELS);
-              step_backup = blade.dmode_step;
+// a single color blade; dsubmode picks the brightness effect
+static void fx_single_init(const struct dmode_effect_struct *fx) {
+  blade.dmode_step = 0;
+  set_single_mode();
+}
 
-              #ifdef DEBUG_SERIAL_ENABLED
-              snprintf(serial_buf, SERIAL_BUF_LEN, "WHITE mode enabled! backup: %3d\r\n", step_backup);
-              serial_sendString(serial_buf);
-              #endif
+static void fx_brightness_config(const struct dmode_effect_struct *fx) {
+  brightness_effect_select(dmode_desc.brightness_effect);
+}
 
-              blade.dmode_step = 255;
-            }
-          }
-          set_dcp_color(blade.dmode_step);  // display new color
-          break;
+// the color the color picker picked; keep dmode_step as it holds the picked color
+static void fx_picked_init(const struct dmode_effect_struct *fx) {
+  set_dcp_color(blade.dmode_step);
+  set_single_mode();
+}
 
-        default:
-          break;
-      }
-    }
-    last_blade_state = blade.state;
+// colors sent by an extended command frame
+static void fx_custom_init(const struct dmode_effect_struct *fx) {
+  blade.dmode_step = 0;
+  apply_custom_segment_colors();
+  set_multi_mode();
+}
+
+// multi-color presets; dsubmode picks the preset, and once every preset has been seen, cycles
+// through them again with each brightness effect in turn
+static void fx_multi_init(const struct dmode_effect_struct *fx) {
+  blade.dmode_step = 0;
+  set_multi_mode();
+}
+
+static void fx_multi_config(const struct dmode_effect_struct *fx) {
+  uint8_t preset = dmode_desc.variant;
+  uint8_t i;
+
+  fade_capture();
+  for (i=0;i<BLADE_SEGMENTS;i++) {
+    set_custom_segment_color(i,
+      blade_multi_colors[preset][i][0],
+      blade_multi_colors[preset][i][1],
+      blade_multi_colors[preset][i][2]
+    );
   }
+  fade_start(FADE_TIME_MULTI);
+  brightness_effect_select(dmode_desc.brightness_effect);
+}
+
+// the color wheels; dsubmode controls the speed of the wheel. the wheel takes a full turn every
+// 256 * period milliseconds, where period is 25 - (speed * 4), speed being dsubmode reduced to one of
+// 6 speeds, or the extended command's override. the hue advances every frame, so the only division
+// happens here
+#define WHEEL_HUE_PER_PERIOD  256   // hue covered per period; one step of the old 256-step wheel
 
-  // don't do anything while clash is in effect.
-  //if ( (blade.state & 0xF0) == BLADE_STATE_CLASH || (blade.state & 0xF0) == BLADE_STATE_OFF ) {
-  if ( (blade.state & 0xF0) == BLADE_STATE_CLASH ) {
-    return;
+static void fx_wheel_config(const struct dmode_effect_struct *fx) {
+  uint16_t period = effect_period(25 - (dmode_desc.variant * 4));
+
+  wheel_rate = (WHEEL_HUE_PER_PERIOD + (period >> 1)) / period;
+  if (wheel_rate == 0) {
+    wheel_rate = 1;
   }
+  brightness_effect_select(DSUBMODE_NORMAL);
+}
 
-  // do any needed initialization for the new dmode
-  if (blade.dmode != last_dmode) {
+static void fx_blade_wheel_init(const struct dmode_effect_struct *fx) {
+  blade.dmode_step = DCP_MIDDLE_LEVEL * DCP_COLOR_COUNT;
+  wheel_hue = blade.dmode_step << 8;
+  set_single_mode();
+}
+
+static uint16_t fx_blade_wheel(const struct dmode_effect_struct *fx, uint16_t dt) {
+  wheel_hue += wheel_rate * dt;
+  blade.dmode_step = wheel_hue >> 8;
+  set_blade_color_hsv(wheel_hue, 255, 255);
+  return FRAME_PERIOD;
+}
+
+static void fx_segment_wheel_init(const struct dmode_effect_struct *fx) {
+  blade.dmode_step = rng_range(16) * 17;  // pick a random starting color
+  wheel_hue = blade.dmode_step << 8;
+  set_multi_mode();
+}
+
+// each segment is 1/16th of the wheel behind the one below it
+static uint16_t fx_segment_wheel(const struct dmode_effect_struct *fx, uint16_t dt) {
+  wheel_hue += wheel_rate * dt;
+  blade.dmode_step = wheel_hue >> 8;
+  set_segment_color_hsv(3, wheel_hue, 255, 255);
+  set_segment_color_hsv(2, wheel_hue + 0x1000, 255, 255);
+  set_segment_color_hsv(1, wheel_hue + 0x2000, 255, 255);
+  set_segment_color_hsv(0, wheel_hue + 0x3000, 255, 255);
+  return FRAME_PERIOD;
+}
+
+// the color picker; dsubmode controls the step size, see DCP STEPPING
+static void fx_picker_init(const struct dmode_effect_struct *fx) {
+  blade.dmode_step = DCP_MIDDLE_LEVEL * DCP_COLOR_COUNT;
+  set_single_mode();
+}
+
+static void fx_picker_config(const struct dmode_effect_struct *fx) {
+  dcp_next = dcp_next_color[dmode_desc.variant];
+  #ifdef DEBUG_SERIAL_ENABLED
+    dcp_step_table_dump();
+  #endif
+  brightness_effect_select(DSUBMODE_NORMAL);
+}
+
+// a clash changes the color picker's brightness level
+static void fx_picker_clash(const struct dmode_effect_struct *fx) {
+  color_slot.next_step_time = frame_time + 4000;    // pause auto-picker briefly after brightness change
+
+  // stepping out of white, restore stored dmode_step value
+  if (blade.dmode_step == 255) {
+    blade.dmode_step = step_backup;
 
     #ifdef DEBUG_SERIAL_ENABLED
-      snprintf(serial_buf, SERIAL_BUF_LEN, "New DMODE detected: 0x%02X\r\n", blade.dmode);
-      serial_sendString(serial_buf);
+    snprintf(serial_buf, SERIAL_BUF_LEN, "WHITE mode ended! restored: %3d\r\n", step_backup);
+    serial_sendString(serial_buf);
     #endif
 
-    // record new dmode
-    last_dmode = blade.dmode;
+    step_backup = DCP_MIDDLE_LEVEL * DCP_COLOR_COUNT;
+  } else {
+
+    // increment brightness level
+    blade.dmode_step += DCP_COLOR_COUNT;
+
+    // did we go past full brightness
+    if (blade.dmode_step >= (DCP_COLOR_COUNT * DCP_BRIGHTNESS_LEVELS) || (blade.dmode_step < DCP_COLOR_COUNT)) {
+      blade.dmode_step += 256 - (DCP_COLOR_COUNT * DCP_BRIGHTNESS_LEVELS);
+      step_backup = blade.dmode_step;
+
+      #ifdef DEBUG_SERIAL_ENABLED
+      snprintf(serial_buf, SERIAL_BUF_LEN, "WHITE mode enabled! backup: %3d\r\n", step_backup);
+      serial_sendString(serial_buf);
+      #endif
+
+      blade.dmode_step = 255;
+    }
+  }
+  fade_capture();
+  set_dcp_color(blade.dmode_step);  // display new color
+  fade_start(FADE_TIME_CLASH);
+}
 
-    // do not reset dmode_step if new dmode is color_picked as dmode_step contains the color that was picked
-    if (blade.dmode != DMODE_COLOR_PICKER_PICKED) {
-      blade.dmode_step = 0;  // reset dmode step
+static uint16_t fx_picker(const struct dmode_effect_struct *fx, uint16_t dt) {
+  uint8_t dcp_color_value;
+  uint8_t dcp_level_base;
+
+  /* The Color Picker: An Overly-Complicated Thing or My Decent Into Madness
+   * A story by Ruthsarian
+           *
+   * \\\ There MUST be a much simpler, more logical, all around BETTER way to achieve this
+   * /// effect, but I can't figure it out. I think I've painted myself into a corner and
+   * \\\ and can't escape. Anyways...
+   * 
+   * The color picker value is stored in the variable blade.dmode_step, an unsigned 
+   * 8-bit value (0-255), while the blade's dmode state is DMODE_COLOR_PICKER or 
+   * DMODE_COLOR_PICKER_PICKED.
+   * 
+   * The color picker supports multiple levels of brightness. How many levels
+   * is determined by the define DCP_BRIGHTNESS_LEVELS. 
+   *
+   * "Brightness" in this context refers to adjusting the color towards or away from
+   * the color white. It does not increase the luminance of the blade. This makes it
+   * possible for the color picker to produce pastel colors as well as dim colors.
+   *
+   * The number of possible color values per level of brightness is calculated at compile time by 
+   * the #define DCP_COLOR_COUNT. As the color picker value is an 8-bit value, 
+   * DCP_COLOR_COUNT is calculated by dividing DCP_MAX_COLORSPACE by DCP_BRIGHTNESS_LEVELS.
+   * 
+   * The color picker begins at middle brightness (colors that are not dim and not pastel).
+   * Brightness level can be changed by triggering a clash while the color picker is active.
+   *
+   * The size of the step taken during color picking (thus the color 'resolution') is controlled by 
+   * the value of blade.dsubmode which increments with each long off/on.
+   *
+   * To simulate colors generated by kyber crystals, the code needs to make sure that as we
+   * step through colors we land on pure red, pure green, pure blue. Purple and yellow colors are
+   * covered by the first level of color resolution, at middle brightness; the configuration of
+   * the color picker when it first starts.
+   * 
+   * In order to ensure that the color picker lands on blue, green, and red, the code needs to
+   * be aware the formulas being used to generate color values so that it can adjust the value
+   * of dmode_step as needed to land on red, green, and blue.
+   *
+   * These formulas are found in set_segment_color_by_wheel_with_brightness() which is located
+   * in blade_state.c. Changes to those formulas may require updates to code here. 
+   * (TODO) Perhaps that entire function should be moved into dmode_handler.c?
+   *
+   * In the variable names and comments in the code below, I make reference to 'color' and 'formula'
+   * the meaning of which I need to explain first.
+   *
+   * The variable blade.dmode_step contains both color and brightness level. The 'color' value
+   * represents the value used to generate the red, green, and blue components prior to adjusting
+   * them to the current brightness level. This will be a value between 0 and DCP_COLOR_COUNT.
+   * 
+   * When calculating the RGB components of the color, each component has a separate formula that is 
+   * applied to the color value to determine that component's value. When referring to the 'formula'
+   * I am referring to the formula used to calculate a single component of the three RGB components.
+   * Thus there are 3 'formulas'.
+   *
+   * 'formula' is taken into account to identify the point at which the color value would be pure
+   * red, pure green, or pure blue. that way blade.dmode_step can be adjusted to land exactly at
+   * that color when it would otherwise skip past it.
+   * (TODO) Perhaps I need to replace 'formula' with 'component' in the comments and variable names.
+   *
+   * About White
+   * With this setup, the max brightness level is all white. That's DCP_COLOR_COUNT worth of color space
+   * lost to white. If we found some other way to handle white we could regain that space and offer
+   * more colors with more brightness levels!
+   *
+   * How?
+   *  - separate 'white' flag?
+   *    then we have to store more than one 8-bit value in order to reproduce white the next time the
+   *    blade is ignited.
+   *
+   *  - 255 = white, 0-254 = colors
+   *    could work, except we lose the color we were previously on, so if we're brightness-changing through
+   *    to dark for a color that you like, we lose that color, so it won't work.
+   *
+   *    unless we store the previous value prior to turning white somewhere temporarily and pull it back in 
+   *    when we get out of white. We care about remembering that value during the color picking process, but
+   *    not after. we'd have to store it in a variable that persists through function calls (a local static
+   *    or global variable).
+   *
+   *    also need a way to tell the code what the max colorspace is (255 instead of 256 (0-255)) if we use
+   *    255 to represent white. then we have to add support for this in the color setting function as well.
+   *    this also means white will always exist as a brightness level. so even if brightness_levels is set to 1
+   *    we really have 2 levels to work with.
+   *
+   */
+
+  // only step to next color if blade is in an on state.
+  // this prevents color-stepping during ignition and extinguish
+  // (TODO) make sure blade.dmode_step can only reach 255 when swapping to white!
+  if ((blade.state & 0xF0) == BLADE_STATE_ON && blade.dmode_step != 255) {
+
+    // the step size is based on the value of blade.dsubmode which increments with a long off/on;
+    // as dsubmode increases, step will decrease, allowing for more colors to be selected.
+    // dcp_next points at the precalculated next colors for the current step size, see DCP STEPPING
+    //
+    // split dmode_step into the start of its brightness level and its color, then look up
+    // the next color. the brightness level never changes here; that's done with a clash
+    dcp_color_value = blade.dmode_step;
+    dcp_level_base = 0;
+    while (dcp_color_value >= DCP_COLOR_COUNT) {
+      dcp_color_value -= DCP_COLOR_COUNT;
+      dcp_level_base += DCP_COLOR_COUNT;
     }
-    last_dsubmode = blade.dsubmode - 1;  // force new dsubmode code to execute by changing value of last_dsubmode
+    blade.dmode_step = dcp_level_base + dcp_next[dcp_color_value];
+  }
 
-    // if blade state has just been loaded from eeprom
-    if (state_loaded_from_eeprom != 0) {
+  fade_capture();
+  set_dcp_color(blade.dmode_step);
+  fade_start(FADE_TIME_PICKER);
+  return 2000;
+}
+
+// effect scripts from EEPROM; the script sets colors and brightness itself, and dsubmode picks the script
+static void fx_script_init(const struct dmode_effect_struct *fx) {
+  blade.dmode_step = 0;
+  set_multi_mode();
+}
+
+static void fx_script_config(const struct dmode_effect_struct *fx) {
+  script_select(dmode_desc.variant);
+  brightness_effect_select(DSUBMODE_NORMAL);
+}
+
+static uint16_t fx_script(const struct dmode_effect_struct *fx, uint16_t dt) {
+  script_run((uint8_t)dt);    // asking for FRAME_PERIOD keeps dt within FRAME_PERIOD + FRAME_DT_MAX
+  return FRAME_PERIOD;
+}
+
+// color effects, indexed by DMODE_*
+//
+// param[0] is how many settings blade.dsubmode cycles the effect through, and dmode_desc.variant the
+// setting it's on; 0 passes dsubmode through untouched. when param[1] is set, blade.dsubmode goes on
+// to pick a brightness effect each time the settings have been cycled through; otherwise the effect
+// runs without one
+#define DMODE_VARIANTS(n, brightness) {(n), (brightness)}
+
+//                                           init                   config                clash            step              period        param
+static const struct dmode_effect_struct color_effects[DMODE_SCRIPT + 1] = {
+  [DMODE_STOCK]               = {fx_single_init,        fx_brightness_config, NULL,            NULL,             0,            DMODE_VARIANTS(1, 1)},
+  [DMODE_COLOR_PICKER]        = {fx_picker_init,        fx_picker_config,     fx_picker_clash, fx_picker,        2000,         DMODE_VARIANTS(DCP_STEP_COUNT, 0)},
+  [DMODE_COLOR_PICKER_PICKED] = {fx_picked_init,        fx_brightness_config, NULL,            NULL,             0,            DMODE_VARIANTS(1, 1)},
+  [DMODE_BLADE_WHEEL]         = {fx_blade_wheel_init,   fx_wheel_config,      NULL,            fx_blade_wheel,   FRAME_PERIOD, DMODE_VARIANTS(6, 0)},
+  [DMODE_SEGMENT_WHEEL]       = {fx_segment_wheel_init, fx_wheel_config,      NULL,            fx_segment_wheel, FRAME_PERIOD, DMODE_VARIANTS(6, 0)},
+  [DMODE_MULTI_MODE]          = {fx_multi_init,         fx_multi_config,      NULL,            NULL,             0,            DMODE_VARIANTS(DMULTI_PRESETS, 1)},
+  [DMODE_CUSTOM]              = {fx_custom_init,        fx_brightness_config, NULL,            NULL,             0,            DMODE_VARIANTS(1, 1)},
+  [DMODE_SCRIPT]              = {fx_script_init,        fx_script_config,     NULL,            fx_script,        FRAME_PERIOD, DMODE_VARIANTS(0, 0)},
+};
 
-      // perform actions to set blade into correct state for the given mode
-      switch (blade.dmode) {
-        case DMODE_COLOR_PICKER_PICKED:
-          set_dcp_color(blade.dmode_step);  // set the blade color
-          break;
-      }
+// DISPLAY SETTINGS DESCRIPTOR
+//
+// decode blade.dmode, blade.dsubmode and blade.color_state into dmode_desc when any of them change
+struct dmode_desc_struct dmode_desc = {DMODE_STOCK, 0, DSUBMODE_NORMAL, stock_blade_colors[0], stock_blade_colors[0], &extinguish_timing[0][0]};
 
-      state_loaded_from_eeprom = 0; // clear flag
+void dmode_desc_handler(void) {
+  static uint8_t last_dmode = 255;
+  static uint8_t last_dsubmode = 0;
+  static uint8_t last_color_state = 255;
+  const struct dmode_effect_struct *fx;
+  uint8_t variants, cycles;
+
+  if (blade.dmode != last_dmode || blade.dsubmode != last_dsubmode) {
+    last_dmode = blade.dmode;
+    last_dsubmode = blade.dsubmode;
+
+    dmode_desc.dmode = (blade.dmode <= DMODE_SCRIPT) ? blade.dmode : DMODE_STOCK;
+    fx = &color_effects[dmode_desc.dmode];
+
+    // split dsubmode into the effect's setting and how many times the settings have been cycled through
+    variants = fx->param[0];
+    dmode_desc.variant = blade.dsubmode;
+    cycles = 0;
+    if (variants != 0) {
+      dmode_desc.variant = blade.dsubmode % variants;
+      cycles = blade.dsubmode / variants;
     }
+    dmode_desc.brightness_effect = (fx->param[1]) ? cycles % DSUBMODE_MAX : DSUBMODE_NORMAL;
+  }
 
-    // perform one-time initialization unique for the new dmode
-    switch (blade.dmode) {
-      case DMODE_SEGMENT_WHEEL:
-        blade.dmode_step = (rand() % 16) * 17;  // pick a random starting color
+  if (blade.color_state != last_color_state) {
+    last_color_state = blade.color_state;
 
-      case DMODE_MULTI_MODE:
-        set_multi_mode();
-        break;
+    // the clash color table follows the normal one
+    dmode_desc.color = stock_color(blade.color_state);
+    dmode_desc.clash_color = stock_color(blade.color_state + 0x10);
+    dmode_desc.extinguish = &extinguish_timing[(blade.color_state >> 4) == STOCK_BLADE_COLOR_TABLE_LEGACY][blade.color_state & 0x0F];
+  }
+}
 
-      case DMODE_BLADE_WHEEL:
-      case DMODE_COLOR_PICKER:
-        blade.dmode_step = DCP_MIDDLE_LEVEL * DCP_COLOR_COUNT;
+void dmode_handler(void) {
+  static uint8_t last_dmode = 255;
+  static uint8_t last_dsubmode = 0;
+  static uint8_t last_blade_state = 0;
 
-      case DMODE_STOCK:
-      case DMODE_COLOR_PICKER_PICKED:
-      default:
-        set_single_mode();
-        break;
+  // coming out of a clash
+  if ((last_blade_state & 0xF0) == BLADE_STATE_CLASH && (blade.state & 0xF0) == BLADE_STATE_ON) {
+    if (color_slot.fx != NULL && color_slot.fx->clash != NULL) {
+      color_slot.fx->clash(color_slot.fx);
     }
   }
+  last_blade_state = blade.state;
 
-  // do any needed initialization for the new dsubmode
+  // a new dmode selects a new color effect
+  if (blade.dmode != last_dmode) {
+
+    #ifdef DEBUG_SERIAL_ENABLED
+      snprintf(serial_buf, SERIAL_BUF_LEN, "New DMODE detected: 0x%02X\r\n", blade.dmode);
+      serial_sendString(serial_buf);
+    #endif
+
+    last_dmode = blade.dmode;
+    fade_finish();  // the new dmode sets its own colors
+    effect_start(&color_slot, &color_effects[dmode_desc.dmode]);
+    state_loaded_from_eeprom = 0;
+    last_dsubmode = blade.dsubmode - 1;  // configure the new effect for the current dsubmode
+  }
+
+  // a new dsubmode reconfigures the color effect, which picks the brightness effect
   if (blade.dsubmode != last_dsubmode) {
 
     #ifdef DEBUG_SERIAL_ENABLED
@@ -310,361 +1005,16 @@ void dmode_handler(void) {
       serial_sendString(serial_buf);
     #endif
 
-    switch (blade.dmode) {
-      case DMODE_MULTI_MODE:
-        for (uint8_t i=0;i<4;i++) {
-          set_custom_segment_color(i,
-            blade_multi_colors[blade.dsubmode % blade_multi_colors_len][i][0], 
-            blade_multi_colors[blade.dsubmode % blade_multi_colors_len][i][1],
-            blade_multi_colors[blade.dsubmode % blade_multi_colors_len][i][2]
-          );
-        }
-        break;
-    }
     last_dsubmode = blade.dsubmode;
-    next_step_time = 0;
-  }
-
-  // manage dmode properties and animation;
-  // how often this block of code gets executed is controlled by the next_step_time variable
-  if (millis() >= next_step_time) {
-
-    // set a default next_step_time of 1 second; this means this second of code will, by default, be executed once a second
-    next_step_time = millis() + 1000;
-
-    switch (blade.dmode) {
-
-      case DMODE_STOCK:
-      case DMODE_COLOR_PICKER_PICKED:
-
-        switch (blade.dsubmode % DSUBMODE_MAX) {
-          case DSUBMODE_NORMAL:
-            break;
-
-          // full blade flicker
-          case DSUBMODE_FLICKER_FULL:
-            // dim blade; use segment 0 to represent the brightness of the entire blade
-            if (segment_brightness[0] > 40) {
-              segment_brightness[0] *= .8;
-            }
-
-            // randomly pop blade
-            if ((rand() % 3) == 0) {
-              segment_brightness[0] += (255 - segment_brightness[0])*.5;
-            }
-
-            // copy brightness of segment 0 to rest of segments so entire blade has same brightness
-            segment_brightness[1] = segment_brightness[0];
-            segment_brightness[2] = segment_brightness[0];
-            segment_brightness[3] = segment_brightness[0];
-
-            next_step_time = millis() + 50;
-            break;
-
-          // segmented flicker
-          case DSUBMODE_FLICKER_SEGMENTED:
-            // dim blade
-            for (i=0; i<4; i++) {
-              if (segment_brightness[i] > 40) {
-                segment_brightness[i] *= .8;
-              }
-            }
-
-            // brighten a random segment (why am i reusing a variable? oh well...)
-            next_step_time = (rand() % 4);
-            segment_brightness[next_step_time] += (255 - segment_brightness[next_step_time])*.5;
-
-            next_step_time = millis() + 50;
-            break;
-
-          case DSUBMODE_BREATHING:
-
-            // determine increment or decrement based on even/odd of segment 0
-            if (segment_brightness[0] % 2) {
-
-              if (segment_brightness[0] < 12) {
-                segment_brightness[0] = 8;
-              } else {
-                segment_brightness[0] -= 4;
-              }
-            } else {
-
-              if (segment_brightness[0] > 250) {
-                segment_brightness[0] = 255;
-              } else {
-                segment_brightness[0] += 4;
-              }
-            }
-
-            // propagate values
-            segment_brightness[1] = segment_brightness[0];
-            segment_brightness[2] = segment_brightness[0];
-            segment_brightness[3] = segment_brightness[0];
-
-            // set time between steps
-            next_step_time = millis() + 12;
-
-            // pause breathing at full brightness for a bit
-            if (segment_brightness[0] == 255) {
-              next_step_time += 1500;
-            }
-            break;
-
-          case DSUBMODE_BRIGHTNESS_66:
-            set_blade_brightness(66);
-            break;
-
-          case DSUBMODE_BRIGHTNESS_33:
-            set_blade_brightness(33);
-            break;
-
-          case DSUBMODE_BRIGHTNESS_10:
-            set_blade_brightness(10);
-            break;
-
-          case DSUBMODE_STATIC_GRADIENT_1:
-            set_segment_brightness(0, 100);
-            set_segment_brightness(1, 80);
-            set_segment_brightness(2, 60);
-            set_segment_brightness(3, 40);
-            break;
-
-          case DSUBMODE_STATIC_GRADIENT_2:
-            set_segment_brightness(0, 100);
-            set_segment_brightness(1, 75);
-            set_segment_brightness(2, 50);
-            set_segment_brightness(3, 25);
-            break;
-
-          case DSUBMODE_FLICKER_DARK:
-            // propagate flicker
-            segment_brightness[3] += ((segment_brightness[2] - segment_brightness[3]));
-            segment_brightness[2] += ((segment_brightness[1] - segment_brightness[2]));
-            segment_brightness[1] += ((segment_brightness[0] - segment_brightness[1])*.8);
-
-            // randomly flicker segment 0
-            if ((rand() % 10) == 0) {
-              segment_brightness[0] = (rand() % 60)+20;
-
-              // otherwise brighten segment 0
-            } else {
-              segment_brightness[0] += ((255 - segment_brightness[0])*.5);
-            }
-
-            next_step_time = millis() + 50;
-            break;
-
-          // only dim segment 0, then propagate
-          case DSUBMODE_FLICKER_BRIGHT:
-
-            // propagate flicker
-            for (i = 3; i > 0; i--) {
-              segment_brightness[i] += ((segment_brightness[i-1] - segment_brightness[i]));
-            }
-
-            // randomly flicker segment 0
-            if ((rand() % 5) == 0) {
-              segment_brightness[0] += (rand() % (255-segment_brightness[0]));
-
-            // otherwise dim segment 0
-            } else if (segment_brightness[0] > 20) {
-              segment_brightness[0] *= 0.8;
-            }
-
-            //as first segment gets dimmer the chance of a flicker increases
-            //if (random(8 - (segment_brightness[0]/32)) == 0) {
-
-            next_step_time = millis() + 50;
-            break;
-
-          // segment 0 flickers, other segments are some % of segment 0
-          case DSUBMODE_FLICKER_GRADIENT:
-
-            // propagate flicker
-            segment_brightness[1] = segment_brightness[0] * .7;
-            segment_brightness[2] = segment_brightness[0] * .5;
-            segment_brightness[3] = segment_brightness[0] * .3;
-
-            // flicker at random
-            if ((rand() % 5) == 0) {
-              segment_brightness[0] = 255;
-
-              // or dim
-            } else if (segment_brightness[0] > 40) {
-              segment_brightness[0] *= 0.8;
-            }
-
-            next_step_time = millis() + 50;
-            break;
-
-          default:
-            blade.dsubmode = DSUBMODE_NORMAL;
-            break;
-        }
-        break;
-
-      // step the blade through the color wheel
-      case DMODE_COLOR_PICKER:
-
-        /* The Color Picker: An Overly-Complicated Thing or My Decent Into Madness
-         * A story by Ruthsarian
-                 *
-         * \\\ There MUST be a much simpler, more logical, all around BETTER way to achieve this
-         * /// effect, but I can't figure it out. I think I've painted myself into a corner and
-         * \\\ and can't escape. Anyways...
-         * 
-         * The color picker value is stored in the variable blade.dmode_step, an unsigned 
-         * 8-bit value (0-255), while the blade's dmode state is DMODE_COLOR_PICKER or 
-         * DMODE_COLOR_PICKER_PICKED.
-         * 
-         * The color picker supports multiple levels of brightness. How many levels
-         * is determined by the define DCP_BRIGHTNESS_LEVELS. 
-         *
-         * "Brightness" in this context refers to adjusting the color towards or away from
-         * the color white. It does not increase the luminance of the blade. This makes it
-         * possible for the color picker to produce pastel colors as well as dim colors.
-         *
-         * The number of possible color values per level of brightness is calculated at compile time by 
-         * the #define DCP_COLOR_COUNT. As the color picker value is an 8-bit value, 
-         * DCP_COLOR_COUNT is calculated by dividing DCP_MAX_COLORSPACE by DCP_BRIGHTNESS_LEVELS.
-         * 
-         * The color picker begins at middle brightness (colors that are not dim and not pastel).
-         * Brightness level can be changed by triggering a clash while the color picker is active.
-         *
-         * The size of the step taken during color picking (thus the color 'resolution') is controlled by 
-         * the value of blade.dsubmode which increments with each long off/on.
-         *
-         * To simulate colors generated by kyber crystals, the code needs to make sure that as we
-         * step through colors we land on pure red, pure green, pure blue. Purple and yellow colors are
-         * covered by the first level of color resolution, at middle brightness; the configuration of
-         * the color picker when it first starts.
-         * 
-         * In order to ensure that the color picker lands on blue, green, and red, the code needs to
-         * be aware the formulas being used to generate color values so that it can adjust the value
-         * of dmode_step as needed to land on red, green, and blue.
-         *
-         * These formulas are found in set_segment_color_by_wheel_with_brightness() which is located
-         * in blade_state.c. Changes to those formulas may require updates to code here. 
-         * (TODO) Perhaps that entire function should be moved into dmode_handler.c?
-         *
-         * In the variable names and comments in the code below, I make reference to 'color' and 'formula'
-         * the meaning of which I need to explain first.
-         *
-         * The variable blade.dmode_step contains both color and brightness level. The 'color' value
-         * represents the value used to generate the red, green, and blue components prior to adjusting
-         * them to the current brightness level. This will be a value between 0 and DCP_COLOR_COUNT.
-         * 
-         * When calculating the RGB components of the color, each component has a separate formula that is 
-         * applied to the color value to determine that component's value. When referring to the 'formula'
-         * I am referring to the formula used to calculate a single component of the three RGB components.
-         * Thus there are 3 'formulas'.
-         *
-         * 'formula' is taken into account to identify the point at which the color value would be pure
-         * red, pure green, or pure blue. that way blade.dmode_step can be adjusted to land exactly at
-         * that color when it would otherwise skip past it.
-         * (TODO) Perhaps I need to replace 'formula' with 'component' in the comments and variable names.
-         *
-         * About White
-         * With this setup, the max brightness level is all white. That's DCP_COLOR_COUNT worth of color space
-         * lost to white. If we found some other way to handle white we could regain that space and offer
-         * more colors with more brightness levels!
-         *
-         * How?
-         *  - separate 'white' flag?
-         *    then we have to store more than one 8-bit value in order to reproduce white the next time the
-         *    blade is ignited.
-         *
-         *  - 255 = white, 0-254 = colors
-         *    could work, except we lose the color we were previously on, so if we're brightness-changing through
-         *    to dark for a color that you like, we lose that color, so it won't work.
-         *
-         *    unless we store the previous value prior to turning white somewhere temporarily and pull it back in 
-         *    when we get out of white. We care about remembering that value during the color picking process, but
-         *    not after. we'd have to store it in a variable that persists through function calls (a local static
-         *    or global variable).
-         *
-         *    also need a way to tell the code what the max colorspace is (255 instead of 256 (0-255)) if we use
-         *    255 to represent white. then we have to add support for this in the color setting function as well.
-         *    this also means white will always exist as a brightness level. so even if brightness_levels is set to 1
-         *    we really have 2 levels to work with.
-         *
-         */
-
-        // only step to next color if blade is in an on state.
-        // this prevents color-stepping during ignition and extinguish
-        // (TODO) make sure blade.dmode_step can only reach 255 when swapping to white!
-        if ((blade.state & 0xF0) == BLADE_STATE_ON && blade.dmode_step != 255) {
-
-          // dcp_step value is based on value of blade.dsubmode which increments with a long off/on operation
-          // as dsubmode increases, step will decrease, allowing for more colors to be selected
-          //
-          // these step values are pre-calculated and stored in dcp_step_table[] to make life easier on my 
-          // very weak brain.
-          dcp_step = dcp_step_table[blade.dsubmode % dcp_max_steps];
-
-          // record current brightness level before proceeding. will use this to determine if we've
-          // shot past the current brightness level and correct for that at the end
-          dcp_brightness = (uint8_t)(blade.dmode_step / DCP_COLOR_COUNT);
-
-          // increment to the next step of the color wheel
-          blade.dmode_step += dcp_step;
-
-          // determine the current color value that will be used when setting blade color
-          dcp_color_value = blade.dmode_step % DCP_COLOR_COUNT;
-
-          // derive the current formula value from the color value          
-          dcp_formula_value = dcp_color_value % DCP_FORMULA_SEPARATOR;
-
-          // if too close to next color formula, push dmode_step to next color formula
-          if (DCP_FORMULA_SEPARATOR - dcp_formula_value <= (uint8_t)(dcp_step / 2)) {
-            blade.dmode_step += DCP_FORMULA_SEPARATOR - dcp_formula_value;
-            
-            // recalculate dcp_color_value and dcp_formula_value since dmode_step has changed
-            dcp_color_value = blade.dmode_step % DCP_COLOR_COUNT;
-            dcp_formula_value = dcp_color_value % DCP_FORMULA_SEPARATOR;
-          }
-
-          // if too close to end of color space, reset to start of color space
-          //
-          // color space 'width' is being calculated by (DCP_FORMULA_SEPARATOR * 3) instead
-          // of DCP_COLOR_COUNT because if DCP_COLOR_COUNT is not cleanly divisible
-          // by 3 (R,G,B) we have as much a value of DCP_COLOR_COUNT that could be as much as 
-          // 2 beyond the max color space, which would affects how we detect being near the end of the 
-          // color space
-          if (dcp_color_value >= ((DCP_FORMULA_SEPARATOR * 3) - ((uint8_t)(dcp_step / 2)))) {
-            blade.dmode_step += (DCP_COLOR_COUNT - dcp_color_value);
-
-          // if an increment has overshot to the next color formula, move back to start of next color formula
-          } else if ((dcp_formula_value > 0) && (dcp_formula_value < dcp_step)) {
-            blade.dmode_step -= dcp_formula_value;
-          }
-
-          // did incrementing dmode_step push us into the next brightness level? 
-          if (blade.dmode_step != (dcp_brightness * DCP_COLOR_COUNT) && (blade.dmode_step % DCP_COLOR_COUNT) < dcp_step) {
-
-            // then reduce by 1 brightness level so we maintain the same brightness
-            blade.dmode_step -= DCP_COLOR_COUNT; 
-          }
-        }
-
-        set_dcp_color(blade.dmode_step);
-        next_step_time = millis() + 2000;
-        break;
-
-      case DMODE_BLADE_WHEEL:
-        blade.dmode_step++;
-        set_color_by_wheel(blade.dmode_step);
-        next_step_time = millis() + 25 - ((blade.dsubmode % 6) * 4);  // dsubmode controls speed of wheel
-        break;
-
-      case DMODE_SEGMENT_WHEEL:
-        blade.dmode_step++;
-        set_segment_color_by_wheel(3, blade.dmode_step);
-        set_segment_color_by_wheel(2, blade.dmode_step + 16);
-        set_segment_color_by_wheel(1, blade.dmode_step + 32);
-        set_segment_color_by_wheel(0, blade.dmode_step + 48);
-        next_step_time = millis() + 25 - ((blade.dsubmode % 6) * 4);  // dsubmode controls speed of wheel
-        break;
+    if (color_slot.fx->config != NULL) {
+      color_slot.fx->config(color_slot.fx);
     }
+    color_slot.next_step_time = frame_time;
+  }
+
+  // step the effects; they only step on a new frame, when their period has elapsed
+  effect_run(&color_slot);
+  if (effect_run(&brightness_slot)) {
+    segment_dirty = SEGMENT_DIRTY_ALL;  // brightness effects write segment_brightness directly
   }
 }
@@ -16,6 +16,10 @@
 #define DMODE_MULTI_MODE          5
 #define DMODE_MAX                 6 // maximum dmode value; once reached, dmode will reset to 0
                                     // changing this value? be sure to update RESET_THRESHOLD_COUNT in blade_state.h
+#define DMODE_CUSTOM              6 // custom segment colors sent by an extended command frame (see data.h);
+                                    // sits past DMODE_MAX so it is only reachable through the hilt, not the off/on cycle
+#define DMODE_SCRIPT              7 // run an effect script stored in EEPROM (see script.h); dsubmode picks the script.
+                                    // also only reachable through an extended command frame
 
 // Display Sub-Modes (DSUBMODE)
 #define DSUBMODE_NORMAL             0
@@ -30,30 +34,71 @@
 #define DSUBMODE_BRIGHTNESS_66      9
 #define DSUBMODE_BRIGHTNESS_33      10
 #define DSUBMODE_BRIGHTNESS_10      11
-#define DSUBMODE_MAX                12  // a cheap way to keep track of how many display sub-modes there are
+#define DSUBMODE_FLICKER_UNSTABLE   12
+#define DSUBMODE_FLICKER_FIRE       13
+#define DSUBMODE_SCANNER            14
+#define DSUBMODE_PULSE              15
+#define DSUBMODE_MAX                16  // a cheap way to keep track of how many display sub-modes there are
 
 // DMODE Timing Elements
 #define DMODE_THRESHOLD_TIME    1000  // remain powered off for less than this value in milliseconds to increment display mode (DMODE)
 #define DSUBMODE_THRESHOLD_TIME 3000  // remain powered off for less than this value in milliseconds, but more than DSUBMODE_THRESHOLD_TIME, to increment display sub-mode (DSUBMODE)
 
 // Dynamic Color Picker presets, constraints, and basic formula
-#define DCP_BRIGHTNESS_LEVELS   5                                                       // recommend this be an odd value below 8, must have a value greater than 0
+#ifndef DCP_BRIGHTNESS_LEVELS                                                           // can be set on the compiler command line; the host tests build several
+#define DCP_BRIGHTNESS_LEVELS   5                                                       // recommend this be an odd value below 8; 3 to 42 are supported (see DCP_NEXT_TABLE_MAX)
+#endif
 #define DCP_MAX_COLORSPACE      255
 #define DCP_COLOR_COUNT         (uint16_t)(DCP_MAX_COLORSPACE / DCP_BRIGHTNESS_LEVELS)  // the size of the color value space per brightness level. must be uint16_t because brightness could be 1
 #define DCP_FORMULA_SEPARATOR   (uint8_t)(DCP_COLOR_COUNT / 3)                          // the point at which different color formulas (red, green, blue) come into play
 #define DCP_MIDDLE_LEVEL        (uint8_t)((DCP_BRIGHTNESS_LEVELS - 1) / 2)              // identify the brightness level that represents the 'middle' or 'normal' level of brightness
 #define DCP_MAX_STEP            (uint8_t)(DCP_FORMULA_SEPARATOR / 2)                    // this sets a lower limit on the number of available colors in the color picker (6)
 #define DCP_STEP_TABLE_MAX      32                                                      // set a limit to the size of the color picker step lookup table; should probably be 16 not 32
+#define DCP_NEXT_TABLE_MAX      1024                                                    // limit, in bytes, on the color picker's next-color table in flash; 1 or 2 brightness levels exceed it
 
-// Ensure DCP_BRIGHTNESS_LEVELS is never less than one
-#if (DCP_BRIGHTNESS_LEVELS < 1)
-#error "DCP_BRIGHTNESS_LEVELS must have a value greater than 0."
+// Ensure DCP_BRIGHTNESS_LEVELS is in the supported range. below 3 the color picker's next-color table
+// outgrows DCP_NEXT_TABLE_MAX; above 42 a brightness level has too few colors to step through
+#if (DCP_BRIGHTNESS_LEVELS < 3 || DCP_BRIGHTNESS_LEVELS > 42)
+#error "DCP_BRIGHTNESS_LEVELS must be 3 to 42: fewer makes the color picker's next-color table too big, more leaves too few colors per level."
 #endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// the blade's display settings decoded into the form the handlers use. dmode_desc_handler() rebuilds it
+// whenever blade.dmode, blade.dsubmode or blade.color_state changes, so the division, modulo and
+// nibble decoding happen once per change rather than on every pass through the main loop
+struct dmode_desc_struct {
+  uint8_t dmode;                                      // blade.dmode, or DMODE_STOCK if it isn't a valid display mode
+  uint8_t variant;                                    // blade.dsubmode reduced to the display mode's own range;
+                                                      // the multi preset, wheel speed, picker step size or script
+  uint8_t brightness_effect;                          // the brightness effect (DSUBMODE_*) blade.dsubmode asks for
+  const uint8_t *color;                               // RGB values of the stock color in blade.color_state
+  const uint8_t *clash_color;                         // and of its clash color
+  const struct extinguish_timing_struct *extinguish;  // extinguish timing of the stock color
+};
+
+// GLOBAL: dmode_desc - the decoded display settings; see dmode_desc_struct
+extern struct dmode_desc_struct dmode_desc;
+
+// GLOBAL: custom segment colors used by DMODE_CUSTOM
+extern uint8_t custom_segment_colors[BLADE_SEGMENTS][RGB_SIZE];
+
+// GLOBAL: effect step period in milliseconds set by an extended command frame; 0 = use the effect's own period
+extern uint8_t dmode_effect_period;
+
+// GLOBAL: the brightness effect (DSUBMODE_*) the current display mode is running; DSUBMODE_NORMAL when
+//         nothing in dmode_handler() is manipulating segment brightness
+extern uint8_t dmode_brightness_effect;
+
+// set the blade to the colors stored in custom_segment_colors
+void apply_custom_segment_colors(void);
+
+// rebuild dmode_desc if the blade's display settings have changed; call once per loop pass, after
+// the command handler and before anything that reads dmode_desc
+void dmode_desc_handler(void);
+
 // manage custom display modes and animations
 void dmode_handler(void);
 
@@ -15,14 +15,222 @@
 #include <stdio.h>
 #include <string.h>
 #include <stddef.h>
+#include <avr/io.h>
 #include <avr/eeprom.h>
+#include <util/crc16.h>
 #include "serial.h"
 #include "eeprom.h"
 #include "blade_state.h"
 #include "device_config.h"
+#include "data.h"
+#include "dmode_handler.h"
+#include "calib.h"
 
 const char eeprom_magic[EEPROM_MAGIC_LEN] = "SWGE";
 
+// the EEPROM layout (see eeprom.h) must fit the part. parts with only 128 bytes of EEPROM end with the
+// color calibration, leaving no room for telemetry counters
+_Static_assert(CALIB_LEN <= EEPROM_CALIB_LEN, "the calibration block is larger than its EEPROM area");
+_Static_assert(EEPROM_CALIB_ADDR + EEPROM_CALIB_LEN <= EEPROM_SIZE, "the calibration area doesn't fit in EEPROM");
+#ifdef DATA_TELEMETRY_EEPROM_ENABLED
+_Static_assert(EEPROM_TELEMETRY_ADDR >= EEPROM_CALIB_ADDR + EEPROM_CALIB_LEN, "telemetry counters would overlap the scripts and calibration; DATA_TELEMETRY_EEPROM_ENABLED needs 256 bytes of EEPROM");
+_Static_assert(EEPROM_TELEMETRY_ADDR >= EEPROM_LOG_END, "telemetry counters would overlap the blade state log");
+#endif
+
+// ASYNCHRONOUS COMMITS
+//
+// eeprom_update_byte() busy-waits several milliseconds for every byte it writes, long enough to stall the
+// main loop and drop data line edges. instead, writes are queued as commits and eeprom_handler() carries
+// them out a page at a time: the bytes of a page that differ from what's stored are loaded into the
+// NVMCTRL page buffer through the memory-mapped EEPROM and a single erase/write command is issued. the
+// EEPROM then writes the page on its own while the main loop carries on, and the next page is loaded once
+// it's no longer busy. only bytes loaded into the page buffer are erased and written, so unchanged bytes
+// cost no wear, just as with eeprom_update_byte().
+//
+// nothing waits on the queue. a save that can't be queued yet is left as a request and eeprom_handler()
+// queues it once there's room, so a burst of saves costs the main loop no more than a single one
+struct eeprom_commit_struct {
+  uint16_t addr;                          // next EEPROM address to write
+  uint16_t end;                           // address after the last one to write
+  const uint8_t *data;                    // bytes to write, or NULL to write zeroes; must stay unchanged until committed
+};
+
+#define EEPROM_COMMIT_QUEUE_LEN 4         // must be a power of 2, and hold the 4 commits of a blade state save
+
+static struct eeprom_commit_struct eeprom_commit_queue[EEPROM_COMMIT_QUEUE_LEN];
+static uint8_t eeprom_commit_head = 0;    // index of the commit being written
+uint8_t eeprom_commit_pending = 0;        // number of commits not yet completely written
+
+// saves waiting to be queued; see eeprom_request_handler()
+#define EEPROM_REQUEST_RESET          0x01
+#define EEPROM_REQUEST_STATE          0x02
+#define EEPROM_REQUEST_CUSTOM_COLORS  0x04
+#define EEPROM_REQUEST_TELEMETRY      0x08
+
+static uint8_t eeprom_requests = 0;
+
+// queue a commit; returns 1 if it was queued, 0 if the queue is full
+static uint8_t eeprom_commit(uint16_t addr, const uint8_t *data, uint16_t len) {
+  struct eeprom_commit_struct *c;
+
+  if (eeprom_commit_pending >= EEPROM_COMMIT_QUEUE_LEN) {
+    return 0;
+  }
+  c = &eeprom_commit_queue[(eeprom_commit_head + eeprom_commit_pending) & (EEPROM_COMMIT_QUEUE_LEN - 1)];
+  c->addr = addr;
+  c->end = addr + len;
+  c->data = data;
+  eeprom_commit_pending++;
+  return 1;
+}
+
+static void eeprom_request_handler(void);
+
+void eeprom_handler(void) {
+  struct eeprom_commit_struct *c = &eeprom_commit_queue[eeprom_commit_head];
+  volatile uint8_t *mapped;
+  uint16_t page_end;
+  uint8_t b, loaded = 0;
+
+  // queue any saves that were waiting for room
+  if (eeprom_requests != 0) {
+    eeprom_request_handler();
+  }
+
+  // nothing to do, or the EEPROM is still writing the last page
+  if (eeprom_commit_pending == 0 || (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm)) {
+    return;
+  }
+
+  // the commit at the head of the queue has been completely written
+  if (c->addr >= c->end) {
+    eeprom_commit_head = (eeprom_commit_head + 1) & (EEPROM_COMMIT_QUEUE_LEN - 1);
+    eeprom_commit_pending--;
+    return;
+  }
+
+  // load the changed bytes of the commit that fall on the current page into the page buffer
+  page_end = (c->addr | (EEPROM_PAGE_SIZE - 1)) + 1;
+  if (page_end > c->end) {
+    page_end = c->end;
+  }
+  while (c->addr < page_end) {
+    b = 0;
+    if (c->data) {
+      b = *c->data;
+      c->data++;
+    }
+    mapped = (volatile uint8_t *)(MAPPED_EEPROM_START + c->addr);
+    if (*mapped != b) {
+      *mapped = b;
+      loaded = 1;
+    }
+    c->addr++;
+  }
+
+  // and write them; the page buffer is cleared once the command completes
+  if (loaded) {
+    _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, NVMCTRL_CMD_PAGEERASEWRITE_gc);
+  }
+}
+
+void eeprom_commit_flush(void) {
+  while (eeprom_commit_pending || eeprom_requests) {
+    eeprom_handler();
+  }
+}
+
+// chunks stored by extended commands are copied here, since the frame they arrived in is reused
+static uint8_t eeprom_chunk[DATA_EXT_MAX_LEN];
+
+// queue a chunk from an extended command; returns 0 if it can't be queued yet. the copy is only replaced
+// once everything queued has been written, which frames arrive far enough apart for that it rarely has
+// to wait; the caller keeps the frame and tries again on the next pass
+static uint8_t eeprom_commit_chunk(uint16_t addr, const uint8_t *data, uint8_t len) {
+  if (eeprom_commit_pending != 0 || eeprom_requests != 0) {
+    return 0;
+  }
+  memcpy(eeprom_chunk, data, len);
+  return eeprom_commit(addr, eeprom_chunk, len);
+}
+
+// BLADE STATE LOG
+//
+// rewriting the blade state in the same place on every save would wear out those EEPROM cells, so each
+// save writes a record to the next slot of a ring instead, spreading the wear over every slot. a record
+// carries a sequence number and a CRC, and the CRC is committed separately after the rest of the record,
+// so a save cut short by pulling the blade leaves a record that fails its CRC and the one before it is
+// used. at startup the ring is scanned for the valid record with the newest sequence number.
+//
+// parts with only 128 bytes of EEPROM have room for a single record, so there is no ring to spread the
+// wear and a save cut short loses the only record; they only save when the blade goes to sleep
+struct eeprom_log_record_struct {
+  uint8_t seq;                            // one more than the record before it; wraps
+  struct blade_state_struct state;
+  uint8_t crc;                            // CRC-8 (CCITT) of seq and state, starting from EEPROM_LOG_CRC_INIT
+};
+
+#define EEPROM_LOG_RECORDS  ((EEPROM_LOG_END - EEPROM_LOG_ADDR) / sizeof(struct eeprom_log_record_struct))
+#define EEPROM_LOG_NONE     0xFF          // eeprom_log_slot when the log holds no valid record
+
+_Static_assert(EEPROM_LOG_RECORDS >= 1, "the blade state log has no room for a record");
+#ifdef EEPROM_LOG_WEAR_LEVELING
+_Static_assert(EEPROM_LOG_RECORDS > 1, "EEPROM_LOG_WEAR_LEVELING needs a blade state log of more than one record");
+#endif
+
+static uint8_t eeprom_log_slot = EEPROM_LOG_NONE;   // slot of the newest valid record
+static uint8_t eeprom_log_seq = 0;                  // and its sequence number
+
+// a copy of the newest record; it's the source of the commit that writes a new record to the log
+static struct eeprom_log_record_struct eeprom_log_record;
+
+// the source of the commit that marks the log as in use
+static const uint8_t eeprom_log_flag = EEPROM_LOG_FLAG;
+
+// EEPROM address of a log slot
+static uint16_t eeprom_log_addr(uint8_t slot) {
+  return EEPROM_LOG_ADDR + ((uint16_t)slot * sizeof(struct eeprom_log_record_struct));
+}
+
+// returns 1 if a log slot holds a record that passes its CRC
+static uint8_t eeprom_log_valid(uint8_t slot) {
+  uint16_t addr = eeprom_log_addr(slot);
+  uint8_t i, crc = EEPROM_LOG_CRC_INIT;
+
+  for (i=0; i<sizeof(struct eeprom_log_record_struct) - 1; i++) {
+    crc = _crc8_ccitt_update(crc, eeprom_read_byte((uint8_t *)addr));
+    addr++;
+  }
+  return (crc == eeprom_read_byte((uint8_t *)addr));
+}
+
+// find the newest valid record in the log. sequence numbers are compared by their signed difference so
+// they can wrap; the log holds far fewer than 128 records, so the difference is never ambiguous
+static void eeprom_log_scan(void) {
+  uint8_t slot, seq;
+
+  eeprom_log_slot = EEPROM_LOG_NONE;
+  for (slot=0; slot<EEPROM_LOG_RECORDS; slot++) {
+    if (eeprom_log_valid(slot)) {
+      seq = eeprom_read_byte((uint8_t *)eeprom_log_addr(slot));
+      if (eeprom_log_slot == EEPROM_LOG_NONE || (int8_t)(seq - eeprom_log_seq) > 0) {
+        eeprom_log_slot = slot;
+        eeprom_log_seq = seq;
+      }
+    }
+  }
+}
+
+// returns 1 if the newest record in the log already holds the current blade state. the record is
+// compared from its copy in RAM since it may not have been committed yet
+static uint8_t eeprom_log_current(void) {
+  if (eeprom_log_slot == EEPROM_LOG_NONE) {
+    return 0;
+  }
+  return (memcmp(&eeprom_log_record.state, &blade, sizeof(struct blade_state_struct)) == 0);
+}
+
+#ifdef DEBUG_SERIAL_ENABLED
 void eeprom_dump(void) {
   uint16_t addr;
 
@@ -54,34 +262,53 @@ void eeprom_dump(void) {
   }
   serial_sendString("\r\n\r\n");
 }
+#endif
 
 void eeprom_setup(void) {
   #ifdef DEBUG_SERIAL_ENABLED
     eeprom_dump();
   #endif
   eeprom_load_state();
+  calib_load();
+  #ifdef DATA_TELEMETRY_EEPROM_ENABLED
+    eeprom_load_telemetry();
+  #endif
 }
 
+// reset the EEPROM. anything still waiting to be saved is dropped, since it's about to be cleared; the
+// reset is queued once everything before it has been written
 void eeprom_reset(void) {
-  uint16_t addr = EEPROM_START_ADDR;
-  uint8_t i;
-
   #ifdef DEBUG_SERIAL_ENABLED
     serial_sendString("Initializing EEPROM\r\n");
   #endif
 
-  // always use eeprom_update over eeprom_write in order to save lifespan of EEPROM
-  //eeprom_update_block((void*)eeprom_magic, (void*)0, sizeof(char)*EEPROM_MAGIC_LEN);
-  for(i=0; i<EEPROM_MAGIC_LEN; i++) {
-    eeprom_update_byte((uint8_t *)addr, eeprom_magic[i]);
-    addr++;
-  }
+  eeprom_requests = EEPROM_REQUEST_RESET;
+  eeprom_request_handler();
+}
 
-  // initialize blade struct area of EEPROM with all zeroes
-  for (i=0; i<sizeof(struct blade_state_struct); i++) {
-    eeprom_update_byte((uint8_t *)addr, 0);
-    addr++;
-  }
+// queue the commits of eeprom_reset(); needs an empty queue
+static void eeprom_reset_commit(void) {
+
+  // commits only write bytes that differ from what's stored, saving the lifespan of the EEPROM just as
+  // eeprom_update_byte() does. they complete in the background while the blade sits in its reset period
+  eeprom_commit(EEPROM_START_ADDR, (const uint8_t *)eeprom_magic, EEPROM_MAGIC_LEN);
+
+  // zero everything between the magic and the color calibration: the blade state, custom colors and
+  // scripts. a 0 byte is SCRIPT_OP_END, so this also clears the scripts
+  eeprom_commit(EEPROM_START_ADDR + EEPROM_MAGIC_LEN, NULL, EEPROM_CALIB_ADDR - (EEPROM_START_ADDR + EEPROM_MAGIC_LEN));
+
+  // empty the blade state log; a record of all zeroes fails its CRC, so the zeroed state above is loaded
+  eeprom_commit(EEPROM_LOG_ADDR, NULL, EEPROM_LOG_END - EEPROM_LOG_ADDR);
+  eeprom_log_slot = EEPROM_LOG_NONE;
+  eeprom_log_seq = 0;
+
+  // the color calibration is left alone; it belongs to the blade's LEDs, not its settings. erased EEPROM
+  // reads 0xFF, which is not a valid calibration version, so a new blade displays colors uncorrected
+
+  // zero the telemetry counters; erased EEPROM reads 0xFF, which would look like saturated counters
+  #ifdef DATA_TELEMETRY_EEPROM_ENABLED
+    eeprom_commit(EEPROM_TELEMETRY_ADDR, NULL, sizeof(struct data_telemetry_struct));
+  #endif
 }
 
 // load the blade state from eeprom
@@ -90,6 +317,9 @@ void eeprom_load_state(void) {
   uint8_t i;
   uint8_t *bs = (uint8_t*)&blade;
 
+  // everything queued must reach the EEPROM before it's read back
+  eeprom_commit_flush();
+
   // test for EEPROM magic
   for(i=0;i<EEPROM_MAGIC_LEN;i++) {
 
@@ -102,6 +332,7 @@ void eeprom_load_state(void) {
 
       // reset EEPROM if magic is missing
       eeprom_reset();
+      eeprom_commit_flush();
       break;
     }
     addr++;
@@ -111,11 +342,32 @@ void eeprom_load_state(void) {
     serial_sendString("Loading blade state from EEPROM...\r\n");
   #endif
 
-  // load blade state from eeprom
-  addr = EEPROM_START_ADDR + sizeof(eeprom_magic);
-  for(i=0;i<sizeof(struct blade_state_struct);i++) {
-    *bs = eeprom_read_byte((uint8_t *)addr);
-    bs++;
+  // load blade state from the newest record in the log. if there isn't one, load it from where the
+  // blade state was stored before there was a log, unless the log has been written, in which case the
+  // last save was cut short and the default state, all zeroes as after eeprom_reset(), is used
+  eeprom_log_scan();
+  if (eeprom_log_slot != EEPROM_LOG_NONE) {
+    addr = eeprom_log_addr(eeprom_log_slot);
+    for(i=0;i<sizeof(struct eeprom_log_record_struct);i++) {
+      ((uint8_t*)&eeprom_log_record)[i] = eeprom_read_byte((uint8_t *)addr);
+      addr++;
+    }
+    memcpy(&blade, &eeprom_log_record.state, sizeof(struct blade_state_struct));
+  } else if (eeprom_read_byte((uint8_t *)EEPROM_LOG_FLAG_ADDR) == EEPROM_LOG_FLAG) {
+    memset(&blade, 0, sizeof(struct blade_state_struct));
+  } else {
+    addr = EEPROM_START_ADDR + sizeof(eeprom_magic);
+    for(i=0;i<sizeof(struct blade_state_struct);i++) {
+      *bs = eeprom_read_byte((uint8_t *)addr);
+      bs++;
+      addr++;
+    }
+  }
+
+  // load custom segment colors from eeprom
+  addr = EEPROM_CUSTOM_COLOR_ADDR;
+  for(i=0;i<sizeof(custom_segment_colors);i++) {
+    ((uint8_t*)custom_segment_colors)[i] = eeprom_read_byte((uint8_t *)addr);
     addr++;
   }
 
@@ -128,10 +380,9 @@ void eeprom_load_state(void) {
   #endif
 }
 
-// store contents of blade state struct to EEPROM
+// store contents of blade state struct to EEPROM as a new record in the blade state log. the record is
+// queued and written by eeprom_handler(), so this returns right away
 void eeprom_store_state(void) {
-  uint16_t addr = EEPROM_START_ADDR;
-  uint8_t i;
 
   // do not store to EEPROM if write-protect is enabled or dmode is enabled
   if (switch_config == 0) {
@@ -141,16 +392,136 @@ void eeprom_store_state(void) {
       dump_blade_state();
     #endif
 
-    // write 'magic' to start of EEPROM
-    for(i=0; i<EEPROM_MAGIC_LEN; i++) {
-      eeprom_update_byte((uint8_t *)addr, eeprom_magic[i]);
-      addr++;
+    eeprom_requests |= EEPROM_REQUEST_STATE;
+    eeprom_request_handler();
+  }
+}
+
+// queue the commits of a blade state save; returns 0 if they can't be queued yet. the last record may
+// still be being written from eeprom_log_record, and a save takes 4 commits, so this waits for the queue
+// to empty. the record is built from the blade state at the time it's queued
+static uint8_t eeprom_state_commit(void) {
+  uint8_t i, slot, crc;
+
+  if (eeprom_commit_pending != 0) {
+    return 0;
+  }
+
+  // write 'magic' to start of EEPROM
+  eeprom_commit(EEPROM_START_ADDR, (const uint8_t *)eeprom_magic, EEPROM_MAGIC_LEN);
+
+  // nothing to do if the state hasn't changed since it was last stored
+  if (eeprom_log_current()) {
+    return 1;
+  }
+
+  // build the record for the slot after the newest one
+  slot = eeprom_log_slot + 1;
+  if (slot >= EEPROM_LOG_RECORDS) {
+    slot = 0;
+  }
+  eeprom_log_seq++;
+  eeprom_log_record.seq = eeprom_log_seq;
+  eeprom_log_record.state = blade;
+  crc = EEPROM_LOG_CRC_INIT;
+  for (i=0; i<sizeof(struct eeprom_log_record_struct) - 1; i++) {
+    crc = _crc8_ccitt_update(crc, ((uint8_t*)&eeprom_log_record)[i]);
+  }
+  eeprom_log_record.crc = crc;
+  eeprom_log_slot = slot;
+
+  // mark the log as in use before its first record is written; commits are written in the order
+  // they're queued, and this does nothing once the flag is set
+  eeprom_commit(EEPROM_LOG_FLAG_ADDR, &eeprom_log_flag, 1);
+
+  // the crc, the record's last byte, is committed on its own after the rest of the record. commits are
+  // written in the order they're queued and each one ends with its own page write, so the crc reaches
+  // the EEPROM only after every byte it covers and the record only passes its crc once it's complete
+  eeprom_commit(eeprom_log_addr(slot), (const uint8_t *)&eeprom_log_record, offsetof(struct eeprom_log_record_struct, crc));
+  eeprom_commit(eeprom_log_addr(slot) + offsetof(struct eeprom_log_record_struct, crc), &eeprom_log_record.crc, 1);
+  return 1;
+}
+
+// store custom segment colors to EEPROM; queued and written by eeprom_handler()
+void eeprom_store_custom_colors(void) {
+
+  // do not store to EEPROM if write-protect is enabled or dmode is disabled
+  if (switch_config == 0) {
+    eeprom_requests |= EEPROM_REQUEST_CUSTOM_COLORS;
+    eeprom_request_handler();
+  }
+}
+
+// store part of the effect script area to EEPROM; bytes that would fall past its end are dropped. the
+// chunk is queued and written by eeprom_handler(); eeprom_commit_pending is 0 once it has been written.
+// returns 0 if the chunk can't be queued yet; call again with the same chunk on a later pass
+uint8_t eeprom_store_script(uint8_t offset, const uint8_t *data, uint8_t len) {
+
+  // do not store to EEPROM if write-protect is enabled or dmode is disabled
+  if (switch_config == 0 && offset < EEPROM_SCRIPT_LEN) {
+    if (len > EEPROM_SCRIPT_LEN - offset) {
+      len = EEPROM_SCRIPT_LEN - offset;
     }
+    return eeprom_commit_chunk(EEPROM_SCRIPT_ADDR + offset, data, len);
+  }
+  return 1;
+}
 
-    // write (raw) contents of blade state struct to EEPROM
-    for (i=0; i<sizeof(struct blade_state_struct); i++) {
-      eeprom_update_byte((uint8_t *)addr, ((uint8_t*)&blade)[i]);
-      addr++;
+// store part of the color calibration block to EEPROM; bytes that would fall past its end are dropped.
+// the chunk is queued and written by eeprom_handler(); eeprom_commit_pending is 0 once it has been written.
+// returns 0 if the chunk can't be queued yet; call again with the same chunk on a later pass
+uint8_t eeprom_store_calibration(uint8_t offset, const uint8_t *data, uint8_t len) {
+
+  // do not store to EEPROM if write-protect is enabled or dmode is disabled
+  if (switch_config == 0 && offset < CALIB_LEN) {
+    if (len > CALIB_LEN - offset) {
+      len = CALIB_LEN - offset;
+    }
+    return eeprom_commit_chunk(EEPROM_CALIB_ADDR + offset, data, len);
+  }
+  return 1;
+}
+
+#ifdef DATA_TELEMETRY_EEPROM_ENABLED
+// load telemetry counters from EEPROM so they accumulate across sleeps and power cycles
+void eeprom_load_telemetry(void) {
+  uint16_t addr = EEPROM_TELEMETRY_ADDR;
+  uint8_t i;
+
+  for (i=0; i<sizeof(struct data_telemetry_struct); i++) {
+    ((volatile uint8_t*)&data_telemetry)[i] = eeprom_read_byte((uint8_t *)addr);
+    addr++;
+  }
+}
+
+// store telemetry counters to EEPROM; unlike blade state this ignores the write protect switch
+// since the counters are diagnostic data, not settings. queued and written by eeprom_handler() straight
+// from data_telemetry, so counts that change before a page is loaded are stored as they are then
+void eeprom_store_telemetry(void) {
+  eeprom_requests |= EEPROM_REQUEST_TELEMETRY;
+  eeprom_request_handler();
+}
+#endif
+
+// queue the saves waiting in eeprom_requests as far as the queue has room. a reset goes first and
+// waits for the queue to empty, so nothing requested after it is written before it
+static void eeprom_request_handler(void) {
+  if (eeprom_requests & EEPROM_REQUEST_RESET) {
+    if (eeprom_commit_pending != 0) {
+      return;
     }
+    eeprom_reset_commit();
+    eeprom_requests &= ~EEPROM_REQUEST_RESET;
+  }
+  if ((eeprom_requests & EEPROM_REQUEST_STATE) && eeprom_state_commit()) {
+    eeprom_requests &= ~EEPROM_REQUEST_STATE;
   }
+  if ((eeprom_requests & EEPROM_REQUEST_CUSTOM_COLORS) && eeprom_commit(EEPROM_CUSTOM_COLOR_ADDR, (const uint8_t *)custom_segment_colors, sizeof(custom_segment_colors))) {
+    eeprom_requests &= ~EEPROM_REQUEST_CUSTOM_COLORS;
+  }
+  #ifdef DATA_TELEMETRY_EEPROM_ENABLED
+    if ((eeprom_requests & EEPROM_REQUEST_TELEMETRY) && eeprom_commit(EEPROM_TELEMETRY_ADDR, (const uint8_t *)&data_telemetry, sizeof(struct data_telemetry_struct))) {
+      eeprom_requests &= ~EEPROM_REQUEST_TELEMETRY;
+    }
+  #endif
 }
@@ -8,17 +8,77 @@
 #define EEPROM_START_ADDR 0x00
 #define EEPROM_MAGIC_LEN  4
 
+// custom segment colors (DMODE_CUSTOM) are stored after the magic and blade state
+#define EEPROM_CUSTOM_COLOR_ADDR  0x10
+
+// effect scripts (DMODE_SCRIPT, see script.h) follow the custom colors
+#define EEPROM_SCRIPT_ADDR        0x20
+#define EEPROM_SCRIPT_LEN         64
+
+// color calibration (see calib.h) follows the scripts
+#define EEPROM_CALIB_ADDR         0x60
+#define EEPROM_CALIB_LEN          32
+
+// data line telemetry counters are kept at the very end of EEPROM, well away from the blade state
+#define EEPROM_TELEMETRY_ADDR (EEPROM_SIZE - sizeof(struct data_telemetry_struct))
+
+// the blade state log (see eeprom.c) takes the spare EEPROM between the calibration and the telemetry.
+// parts with only 128 bytes of EEPROM have no spare room, so they keep a single record where the blade
+// state was stored before there was a log. EEPROM_LOG_WEAR_LEVELING is defined when the log holds enough
+// records to spread the wear of frequent saves
+#if (EEPROM_SIZE >= 0x100)
+  #define EEPROM_LOG_WEAR_LEVELING
+  #define EEPROM_LOG_ADDR         0x80
+  #ifdef DATA_TELEMETRY_EEPROM_ENABLED
+    #define EEPROM_LOG_END        EEPROM_TELEMETRY_ADDR
+  #else
+    #define EEPROM_LOG_END        EEPROM_SIZE
+  #endif
+#else
+  #define EEPROM_LOG_ADDR         (EEPROM_START_ADDR + EEPROM_MAGIC_LEN)
+  #define EEPROM_LOG_END          EEPROM_LOG_FLAG_ADDR
+#endif
+
+// EEPROM_LOG_FLAG is stored here before the first record is written to the log. until then the blade
+// state is loaded from where it was stored before there was a log; after that a log with no valid record
+// loads the default state instead, since on parts with a single record the log has taken the old
+// location and a save cut short leaves nothing there worth loading
+#define EEPROM_LOG_FLAG_ADDR      (EEPROM_CUSTOM_COLOR_ADDR - 1)
+#define EEPROM_LOG_FLAG           0xA5
+#define EEPROM_LOG_CRC_INIT       0xFF  // CRC-8 starting value; chosen so neither an all-0x00 nor an all-0xFF record is valid
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern const char eeprom_magic[EEPROM_MAGIC_LEN];
 
+// GLOBAL: eeprom_commit_pending - number of queued EEPROM writes not yet completely written; 0 once all
+// stored data has reached the EEPROM
+extern uint8_t eeprom_commit_pending;
+
+#ifdef DEBUG_SERIAL_ENABLED
 void eeprom_dump(void);
+#endif
 void eeprom_setup(void);
+
+// write queued data to EEPROM a page at a time without waiting on the EEPROM; call every main loop pass
+void eeprom_handler(void);
+
+// wait for every queued write and waiting save to reach the EEPROM; only for startup and sleep
+void eeprom_commit_flush(void);
+
 void eeprom_reset(void);
 void eeprom_load_state(void);
 void eeprom_store_state(void);
+void eeprom_store_custom_colors(void);
+uint8_t eeprom_store_script(uint8_t offset, const uint8_t *data, uint8_t len);
+uint8_t eeprom_store_calibration(uint8_t offset, const uint8_t *data, uint8_t len);
+
+#ifdef DATA_TELEMETRY_EEPROM_ENABLED
+void eeprom_load_telemetry(void);
+void eeprom_store_telemetry(void);
+#endif
 
 #ifdef __cplusplus
 } // extern "C"
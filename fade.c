@@ -0,0 +1,134 @@
+/* fade.c
+ *
+ * per-segment color crossfades; see fade.h
+ *
+ * a fade's progress is a Q16 fraction advanced by a per-millisecond rate, which costs one division
+ * when the fade starts. each frame after that is a multiply to advance progress and, per channel,
+ * a subtract, an 8x8 multiply and a shift.
+ *
+ */
+
+#include <stdint.h>
+#include "blade_state.h"
+#include "frame.h"
+#include "fade.h"
+
+struct fade_struct {
+  uint8_t from[RGB_SIZE];     // color at the start of the fade
+  uint8_t to[RGB_SIZE];       // target color
+  uint16_t progress;          // Q16 fraction of the fade completed
+  uint16_t rate;              // progress added per millisecond
+};
+
+static struct fade_struct fades[BLADE_SEGMENTS];
+static uint8_t fade_active = 0;   // bit n is set while segment n is fading
+
+// blend one channel a fraction t/256 of the way from a to b
+static uint8_t fade_lerp(uint8_t a, uint8_t b, uint8_t t) {
+  if (b >= a) {
+    return a + (uint8_t)(((uint16_t)(b - a) * t) >> 8);
+  }
+  return a - (uint8_t)(((uint16_t)(a - b) * t) >> 8);
+}
+
+// start a fade of one segment from its recorded from color to its recorded to color
+static void fade_begin(uint8_t segment, uint16_t duration) {
+  uint8_t c;
+
+  if (duration == 0) {
+    for (c=0;c<RGB_SIZE;c++) {
+      segment_color[segment][c] = fades[segment].to[c];
+    }
+    fade_active &= ~(1 << segment);
+    return;
+  }
+
+  for (c=0;c<RGB_SIZE;c++) {
+    segment_color[segment][c] = fades[segment].from[c];
+  }
+  fades[segment].progress = 0;
+  fades[segment].rate = 0xFFFF / duration;
+  if (fades[segment].rate == 0) {
+    fades[segment].rate = 1;
+  }
+  fade_active |= (1 << segment);
+}
+
+void fade_segment_color(uint8_t segment, uint8_t red, uint8_t green, uint8_t blue, uint16_t duration) {
+  uint8_t c;
+
+  for (c=0;c<RGB_SIZE;c++) {
+    fades[segment].from[c] = segment_color[segment][c];
+  }
+  fades[segment].to[RED_IDX] = red;
+  fades[segment].to[GRN_IDX] = green;
+  fades[segment].to[BLU_IDX] = blue;
+  fade_begin(segment, duration);
+}
+
+void fade_capture(void) {
+  uint8_t s, c;
+
+  // a fade in progress stops where it is, so the next fade starts from the color actually showing
+  fade_active = 0;
+  for (s=0;s<BLADE_SEGMENTS;s++) {
+    for (c=0;c<RGB_SIZE;c++) {
+      fades[s].from[c] = segment_color[s][c];
+    }
+  }
+}
+
+void fade_start(uint16_t duration) {
+  uint8_t s, c;
+
+  for (s=0;s<BLADE_SEGMENTS;s++) {
+    for (c=0;c<RGB_SIZE;c++) {
+      fades[s].to[c] = segment_color[s][c];
+    }
+    fade_begin(s, duration);
+  }
+}
+
+void fade_finish(void) {
+  uint8_t s, c;
+
+  for (s=0;s<BLADE_SEGMENTS;s++) {
+    if (fade_active & (1 << s)) {
+      for (c=0;c<RGB_SIZE;c++) {
+        segment_color[s][c] = fades[s].to[c];
+      }
+    }
+  }
+  fade_active = 0;
+}
+
+void fade_handler(void) {
+  uint8_t s, c, t;
+  uint32_t step;
+
+  if (fade_active == 0 || frame_dt == 0) {
+    return;
+  }
+
+  for (s=0;s<BLADE_SEGMENTS;s++) {
+    if ((fade_active & (1 << s)) == 0) {
+      continue;
+    }
+
+    // advance the fade; once it reaches the end land exactly on the target color
+    step = (uint32_t)fades[s].rate * frame_dt;
+    if (step >= (uint32_t)(0xFFFF - fades[s].progress)) {
+      for (c=0;c<RGB_SIZE;c++) {
+        segment_color[s][c] = fades[s].to[c];
+      }
+      fade_active &= ~(1 << s);
+      continue;
+    }
+    fades[s].progress += (uint16_t)step;
+
+    t = fades[s].progress >> 8;
+    for (c=0;c<RGB_SIZE;c++) {
+      segment_color[s][c] = fade_lerp(fades[s].from[c], fades[s].to[c], t);
+    }
+  }
+}
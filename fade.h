@@ -0,0 +1,52 @@
+/* fade.h
+ *
+ * per-segment color crossfades. instead of cutting straight to a new color, a segment can be given
+ * a target color and a duration; fade_handler() then blends segment_color toward the target a
+ * little each frame using 8-bit fixed-point interpolation.
+ *
+ * the simplest way to turn an existing color cut into a blend is to wrap it:
+ *
+ *   fade_capture();                   // remember the colors currently on the blade
+ *   set_blade_color();                // any code that writes segment_color
+ *   fade_start(FADE_TIME_COLOR);      // blend from the remembered colors to the new ones
+ *
+ * code that writes segment_color directly while a segment is fading will be overwritten by the fade;
+ * call fade_finish() first.
+ *
+ */ 
+
+#ifndef FADE_H_
+#define FADE_H_
+
+// crossfade durations, in milliseconds
+#define FADE_TIME_COLOR   250   // stock blade color change on a lit blade
+#define FADE_TIME_PICKER  400   // color picker advancing to its next color
+#define FADE_TIME_MULTI   500   // switching between multi-color presets
+#define FADE_TIME_CLASH   80    // color picker settling into a new brightness level after a clash
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// fade a segment from its current color to the given color over duration milliseconds; values are
+// written to segment_color as-is, so pass colors already adjusted the way set_custom_segment_color() would.
+// a duration of 0 sets the color immediately
+void fade_segment_color(uint8_t segment, uint8_t red, uint8_t green, uint8_t blue, uint16_t duration);
+
+// remember the current color of every segment as the starting point for fade_start(); stops any fade in progress
+void fade_capture(void);
+
+// fade every segment from the colors saved by fade_capture() to the colors now in segment_color
+void fade_start(uint16_t duration);
+
+// end all fades, leaving each segment at its target color
+void fade_finish(void);
+
+// advance any fades in progress by frame_dt; call once per loop pass
+void fade_handler(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* FADE_H_ */
@@ -0,0 +1,44 @@
+/* fixed.h
+ *
+ * fixed-point math used in place of floating point. the ATtiny has no FPU, so every float
+ * multiply or divide is a software library call costing hundreds of cycles and a chunk of flash.
+ *
+ * Q16 values are fractions between 0 and 1 scaled by 65536. Q16() converts a constant fraction
+ * at compile time and rounds it up, which makes q16_mul8(x, Q16(f)) truncate the same way
+ * (uint8_t)(x * f) did for every 8-bit x. the Q16 constants used by this firmware were checked
+ * against the float expressions they replace for every possible input; see host/fixed_test.c
+ */
+
+#ifndef FIXED_H_
+#define FIXED_H_
+
+#include <stdint.h>
+
+// convert a constant fraction, 0 <= f < 1, to Q16
+#define Q16(f) ((uint16_t)((f) * 65536.0) + 1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// x * q, where q is a Q16 fraction; rounded down
+static inline uint8_t q16_mul8(uint8_t x, uint16_t q) {
+  return (uint8_t)(((uint32_t)x * q) >> 16);
+}
+
+// (a * b) / 255, rounded down; replaces (uint8_t)(((float)a / 255) * b)
+static inline uint8_t mul8_div255(uint8_t a, uint8_t b) {
+  uint16_t x = (uint16_t)a * b;
+  return (uint8_t)((x + 1 + (x >> 8)) >> 8);
+}
+
+// scale a percentage (0-100) to 0-255, rounded down; replaces (uint8_t)(((float)pct / 100) * 255)
+static inline uint8_t percent_to_u8(uint8_t pct) {
+  return (pct << 1) + q16_mul8(pct, Q16(.55));    // 2.55 = 2 + .55
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* FIXED_H_ */
@@ -0,0 +1,30 @@
+/* frame.c
+ *
+ * fixed-rate frame clock; see frame.h
+ *
+ */
+
+#include <stdint.h>
+#include "millis.h"
+#include "frame.h"
+
+uint32_t frame_time = 0;
+uint8_t frame_dt = 0;
+
+uint8_t frame_handler(void) {
+  uint32_t time_now = millis();
+
+  // step the clock forward in whole frames; no division needed since only a few frames pass per call
+  frame_dt = 0;
+  while ((time_now - frame_time) >= FRAME_PERIOD) {
+    frame_time += FRAME_PERIOD;
+    frame_dt += FRAME_PERIOD;
+
+    // too far behind to catch up; start the grid over from now
+    if (frame_dt >= FRAME_DT_MAX) {
+      frame_time = time_now;
+      break;
+    }
+  }
+  return frame_dt;
+}
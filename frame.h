@@ -0,0 +1,33 @@
+/* frame.h
+ *
+ * a fixed-rate frame clock for blade effects. frame_handler() is called once per main loop pass and
+ * advances frame_time in whole FRAME_PERIOD steps, so effects are ticked on a regular grid instead of
+ * whenever the loop happens to get around to them. frame_dt holds the time covered by the new frame,
+ * normally FRAME_PERIOD but more if the loop ran late, so effects can move at a true rate.
+ *
+ */ 
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#define FRAME_PERIOD  5   // milliseconds per frame; 200Hz
+#define FRAME_DT_MAX  50  // a frame covering more than this (waking from sleep, long stalls) is clamped and the clock resynchronized
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GLOBAL: time, in milliseconds, of the current frame; always a whole number of frames after the clock started
+extern uint32_t frame_time;
+
+// GLOBAL: milliseconds covered by the current frame; 0 when the current loop pass did not start a new frame
+extern uint8_t frame_dt;
+
+// advance the frame clock; returns frame_dt
+uint8_t frame_handler(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* FRAME_H_ */
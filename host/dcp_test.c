@@ -0,0 +1,205 @@
+/* dcp_test.c
+ *
+ * host test of the color picker's compile-time tables in dmode_handler.c. dcp_palette[] and
+ * dcp_next_color[] are compared with the runtime code they replaced, for every wheel value and every
+ * color at every step size. the Makefile builds this once for each of several DCP_BRIGHTNESS_LEVELS,
+ * up to 16; past that the runtime code's 8-bit square of the brightness level overflowed, so it's no
+ * reference there (fixed_test checks the level formula itself for up to 42 levels).
+ *
+ * dmode_handler.c is included whole so its macros can be checked too; the rest of the firmware it
+ * calls is stubbed out below and never run.
+ *
+ */
+
+#include <stdio.h>
+#include "dmode_handler.c"
+
+// stand-ins for the firmware dmode_handler.c talks to
+struct blade_state_struct blade;
+const struct extinguish_timing_struct extinguish_timing[2][STOCK_BLADE_COLORS_PER_TABLE];
+uint8_t frame_dt = 0;
+uint32_t frame_time = 0;
+uint8_t segment_brightness[BLADE_SEGMENTS];
+uint8_t segment_color[BLADE_SEGMENTS][RGB_SIZE];
+uint8_t segment_dirty = 0;
+uint8_t state_loaded_from_eeprom = 0;
+const uint8_t stock_blade_colors[STOCK_BLADE_COLOR_LEN][RGB_SIZE];
+
+void fade_capture(void) {}
+void fade_finish(void) {}
+void fade_start(uint16_t duration) {}
+void motion_light(uint8_t *level, uint16_t pos, uint8_t intensity) {}
+uint8_t noise8_fbm(uint16_t position) { return 0; }
+uint8_t rng_range(uint8_t n) { return 0; }
+void script_run(uint8_t dt) {}
+void script_select(uint8_t n) {}
+void set_blade_color_hsv(uint16_t hue, uint8_t sat, uint8_t val) {}
+void set_custom_segment_color(uint8_t segment, uint8_t red, uint8_t green, uint8_t blue) {}
+void set_multi_mode(void) {}
+void set_segment_brightness(uint8_t segment, uint8_t amount) {}
+void set_segment_color_hsv(uint8_t segment, uint16_t hue, uint8_t sat, uint8_t val) {}
+void set_single_mode(void) {}
+const uint8_t *stock_color(uint8_t color_state) { return stock_blade_colors[0]; }
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// the color picker's color for a wheel value, as set_dcp_segment_color() worked it out at runtime
+static void old_dcp_color(uint8_t wheel_value, uint8_t *rgb) {
+  uint8_t red, green, blue, color, brightness;
+  #if (DCP_BRIGHTNESS_LEVELS > 1)
+  uint8_t square;
+  #endif
+
+  if (wheel_value == 255) {
+    red   = STOCK_BLADE_WHITE_RED;
+    green = STOCK_BLADE_WHITE_GRN;
+    blue  = STOCK_BLADE_WHITE_BLU;
+  } else {
+    color = wheel_value % DCP_COLOR_COUNT;
+    brightness = (uint8_t)(wheel_value / DCP_COLOR_COUNT);
+    if (color < DCP_FORMULA_SEPARATOR) {
+      green = color * 3 * DCP_BRIGHTNESS_LEVELS;
+      red = ~green;
+      blue = 0;
+    } else if (color < (2 * DCP_FORMULA_SEPARATOR)) {
+      color -= DCP_FORMULA_SEPARATOR;
+      blue = color * 3 * DCP_BRIGHTNESS_LEVELS;
+      green = ~blue;
+      red = 0;
+    } else {
+      color -= (2 * DCP_FORMULA_SEPARATOR);
+      red = color * 3 * DCP_BRIGHTNESS_LEVELS;
+      blue = ~red;
+      green = 0;
+    }
+
+    #if (DCP_BRIGHTNESS_LEVELS > 1)
+    if (brightness > DCP_MIDDLE_LEVEL) {
+      square = brightness * brightness;
+      red   -= (uint8_t)(((int16_t)(red   - STOCK_BLADE_WHITE_RED) * square) / (DCP_BRIGHTNESS_LEVELS * DCP_BRIGHTNESS_LEVELS));
+      green -= (uint8_t)(((int16_t)(green - STOCK_BLADE_WHITE_GRN) * square) / (DCP_BRIGHTNESS_LEVELS * DCP_BRIGHTNESS_LEVELS));
+      blue  -= (uint8_t)(((int16_t)(blue  - STOCK_BLADE_WHITE_BLU) * square) / (DCP_BRIGHTNESS_LEVELS * DCP_BRIGHTNESS_LEVELS));
+    } else if (brightness < DCP_MIDDLE_LEVEL) {
+      square = (brightness + 1) * (brightness + 1);
+      red   = (uint8_t)(((uint16_t)red   * square) / ((DCP_MIDDLE_LEVEL + 1) * (DCP_MIDDLE_LEVEL + 1)));
+      green = (uint8_t)(((uint16_t)green * square) / ((DCP_MIDDLE_LEVEL + 1) * (DCP_MIDDLE_LEVEL + 1)));
+      blue  = (uint8_t)(((uint16_t)blue  * square) / ((DCP_MIDDLE_LEVEL + 1) * (DCP_MIDDLE_LEVEL + 1)));
+    }
+    #endif
+  }
+  rgb[RED_IDX] = red;
+  rgb[GRN_IDX] = green;
+  rgb[BLU_IDX] = blue;
+}
+
+// the step sizes, as precalc_dcp_step_table() worked them out at startup
+static uint8_t old_dcp_steps[DCP_STEP_TABLE_MAX];
+static uint8_t old_dcp_step_count = 0;
+
+static void old_dcp_step_table(void) {
+  uint8_t prev_step = 255;
+  uint8_t dsubmode_index = 0;
+  uint8_t step;
+
+  while(1) {
+    step = DCP_FORMULA_SEPARATOR / (2 + dsubmode_index);
+    if (step != prev_step) {
+      old_dcp_steps[old_dcp_step_count++] = step;
+      prev_step = step;
+    }
+    if (step == 1 || old_dcp_step_count >= DCP_STEP_TABLE_MAX) {
+      break;
+    }
+    dsubmode_index++;
+  }
+}
+
+// the wheel value after dmode_step when stepping by dcp_step, as dmode_handler() worked it out at
+// runtime. *overflow is set if the 8-bit dmode_step wrapped along the way
+static uint8_t old_dcp_next(uint8_t dmode_step, uint8_t dcp_step, uint8_t *overflow) {
+  uint8_t dcp_color_value, dcp_formula_value, dcp_brightness;
+  uint16_t wide;
+
+  dcp_brightness = (uint8_t)(dmode_step / DCP_COLOR_COUNT);
+  wide = dmode_step + dcp_step;
+  dmode_step += dcp_step;
+  dcp_color_value = dmode_step % DCP_COLOR_COUNT;
+  dcp_formula_value = dcp_color_value % DCP_FORMULA_SEPARATOR;
+  if (DCP_FORMULA_SEPARATOR - dcp_formula_value <= (uint8_t)(dcp_step / 2)) {
+    wide += DCP_FORMULA_SEPARATOR - dcp_formula_value;
+    dmode_step += DCP_FORMULA_SEPARATOR - dcp_formula_value;
+    dcp_color_value = dmode_step % DCP_COLOR_COUNT;
+    dcp_formula_value = dcp_color_value % DCP_FORMULA_SEPARATOR;
+  }
+  if (dcp_color_value >= ((DCP_FORMULA_SEPARATOR * 3) - ((uint8_t)(dcp_step / 2)))) {
+    wide += (DCP_COLOR_COUNT - dcp_color_value);
+    dmode_step += (DCP_COLOR_COUNT - dcp_color_value);
+  } else if ((dcp_formula_value > 0) && (dcp_formula_value < dcp_step)) {
+    dmode_step -= dcp_formula_value;
+  }
+  *overflow = wide > 255;
+  if (dmode_step != (dcp_brightness * DCP_COLOR_COUNT) && (dmode_step % DCP_COLOR_COUNT) < dcp_step) {
+    dmode_step -= DCP_COLOR_COUNT;
+  }
+  return dmode_step;
+}
+
+// every wheel value the picker can reach has the color the runtime code gave it. a clash keeps
+// dmode_step below DCP_BRIGHTNESS_LEVELS * DCP_COLOR_COUNT, or at 255 for white
+static void test_palette(void) {
+  uint16_t w;
+  uint8_t rgb[RGB_SIZE];
+
+  for (w=0; w<256; w++) {
+    if (w >= DCP_BRIGHTNESS_LEVELS * DCP_COLOR_COUNT && w != 255) {
+      continue;
+    }
+    old_dcp_color(w, rgb);
+    CHECK(dcp_palette[w][RED_IDX] == rgb[RED_IDX] && dcp_palette[w][GRN_IDX] == rgb[GRN_IDX] && dcp_palette[w][BLU_IDX] == rgb[BLU_IDX],
+      "wheel %u is %u,%u,%u; was %u,%u,%u", w, dcp_palette[w][RED_IDX], dcp_palette[w][GRN_IDX], dcp_palette[w][BLU_IDX], rgb[RED_IDX], rgb[GRN_IDX], rgb[BLU_IDX]);
+  }
+}
+
+// the same step sizes, and every step from every wheel value lands where it used to. the one change
+// is at the top brightness level, where a step that wrapped dmode_step past 255 used to land on
+// another color; it now wraps to color 0 of the level like every other level does
+static void test_steps(void) {
+  uint8_t k, step, old, overflow, color, base, wrapped = 0;
+  uint16_t w;
+
+  old_dcp_step_table();
+  CHECK(DCP_STEP_COUNT == old_dcp_step_count, "%u step sizes; there were %u", DCP_STEP_COUNT, old_dcp_step_count);
+
+  for (k=0; k<DCP_STEP_COUNT && k<old_dcp_step_count; k++) {
+    step = DCP_STEP(k);
+    CHECK(step == old_dcp_steps[k], "step size %u is %u; was %u", k, step, old_dcp_steps[k]);
+
+    // white is never stepped from
+    for (w=0; w<DCP_BRIGHTNESS_LEVELS * DCP_COLOR_COUNT; w++) {
+      color = w % DCP_COLOR_COUNT;
+      base = w - color;
+      old = old_dcp_next(w, step, &overflow);
+      if (overflow) {
+        CHECK(base + dcp_next_color[k][color] == base, "step %u from %u wrapped past 255 and should land on color 0 of its level, not %u", step, w, base + dcp_next_color[k][color]);
+        wrapped++;
+      } else {
+        CHECK(base + dcp_next_color[k][color] == old, "step %u from %u lands on %u; used to land on %u", step, w, base + dcp_next_color[k][color], old);
+      }
+    }
+  }
+  printf("color picker, %u levels: %u step sizes, %u steps that used to wrap past 255\n", DCP_BRIGHTNESS_LEVELS, DCP_STEP_COUNT, wrapped);
+}
+
+int main(void) {
+  test_palette();
+  test_steps();
+
+  if (failures != 0) {
+    printf("dcp_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("dcp_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,160 @@
+/* fixed_test.c
+ *
+ * host test of the fixed-point math in fixed.h against the floating point expressions it replaced,
+ * for every 8-bit input. avr-gcc's double is a 32-bit float, so the originals are evaluated in float
+ * here too.
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "fixed.h"
+#include "blade_state.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// a float result stored to a uint8_t, as the original code did. values are truncated toward zero;
+// anything outside 0-255 wraps through int16_t, as the integer versions do, since C leaves a float
+// that doesn't fit an unsigned type undefined
+static uint8_t to_u8(float f) {
+  return (uint8_t)(int16_t)f;
+}
+
+// the Q16 constants that replaced a float multiply, and the fraction each one replaced
+static const struct {
+  const char *name;
+  uint16_t q;
+  float f;
+} q16_consts[] = {
+  {"RED_ADJUST", RED_ADJUST, .79f},
+  {"Q16(.8)",    Q16(.8),    .8f},
+  {"Q16(.7)",    Q16(.7),    .7f},
+  {"Q16(.3)",    Q16(.3),    .3f},
+  {"Q16(.2)",    Q16(.2),    .2f},
+  {"Q16(.55)",   Q16(.55),   .55f}
+};
+
+// q16_mul8(x, Q16(f)) replaced (uint8_t)(x * f)
+static void test_q16_mul8(void) {
+  uint8_t i;
+  uint16_t x;
+
+  for (i=0; i<sizeof(q16_consts)/sizeof(q16_consts[0]); i++) {
+    for (x=0; x<256; x++) {
+      CHECK(q16_mul8(x, q16_consts[i].q) == to_u8((float)x * q16_consts[i].f), "q16_mul8(%u, %s) = %u, float gives %u", x, q16_consts[i].name, q16_mul8(x, q16_consts[i].q), to_u8((float)x * q16_consts[i].f));
+    }
+  }
+
+  // x >> 1 replaced x * .5
+  for (x=0; x<256; x++) {
+    CHECK((x >> 1) == to_u8((float)x * .5f), "%u >> 1 differs from %u * .5", x, x);
+  }
+}
+
+// mul8_div255(a, b) replaced (uint8_t)(((float)a / 255) * b)
+static void test_mul8_div255(void) {
+  uint16_t a, b;
+
+  for (a=0; a<256; a++) {
+    for (b=0; b<256; b++) {
+      CHECK(mul8_div255(a, b) == to_u8(((float)a / 255) * b), "mul8_div255(%u, %u) = %u, float gives %u", a, b, mul8_div255(a, b), to_u8(((float)a / 255) * b));
+    }
+  }
+}
+
+// percent_to_u8(pct) replaced (uint8_t)(((float)pct / 100) * 255); only 0-100 are percentages, but
+// every 8-bit input is checked
+static void test_percent_to_u8(void) {
+  uint16_t pct;
+
+  for (pct=0; pct<256; pct++) {
+    CHECK(percent_to_u8(pct) == to_u8(((float)pct / 100) * 255), "percent_to_u8(%u) = %u, float gives %u", pct, percent_to_u8(pct), to_u8(((float)pct / 100) * 255));
+  }
+}
+
+// fx_flicker_dark() in dmode_handler.c moves segment 1 80% of the way toward segment 0. it replaced
+// s1 += (s0 - s1) * .8, which can go either way, with one multiply for each direction
+static void test_flicker_dark(void) {
+  uint16_t s0, s1;
+  uint8_t fixed;
+
+  for (s0=0; s0<256; s0++) {
+    for (s1=0; s1<256; s1++) {
+      if (s0 >= s1) {
+        fixed = s1 + q16_mul8(s0 - s1, Q16(.8));
+      } else {
+        fixed = s0 + q16_mul8(s1 - s0, Q16(.2));
+      }
+      CHECK(fixed == to_u8(s1 + (float)((int16_t)s0 - (int16_t)s1) * .8f), "segment 1 at %u moving toward %u: %u, float gives %u", s1, s0, fixed, to_u8(s1 + (float)((int16_t)s0 - (int16_t)s1) * .8f));
+    }
+  }
+}
+
+// the color picker's brightness levels. a component x at level l above the middle level is blended
+// toward the stock white component by (l / levels)^2 and one below it is darkened by
+// ((l + 1) / (middle + 1))^2. the integer ratios of squares replaced pow(); see DCP_SHADE() in
+// dmode_handler.c, which builds the palette with the same integer math. checked for 1 to 42 levels.
+//
+// where the exact result is a whole number the float code can miss it by a hair and truncate to the
+// next integer toward zero; e.g. 180 * (5 / 12)^2 is 125 but comes out as 124.99999. the integer math
+// gives the exact result there. those points are counted and reported; any other difference fails.
+// none of them are at the default DCP_BRIGHTNESS_LEVELS of 5
+static uint16_t dcp_float_rounding = 0;
+
+// 1 if fixed is the exact value num / den, a whole number, and f misses it only by float rounding
+static uint8_t dcp_rounding(uint8_t fixed, float f, int32_t num, int32_t den) {
+  if (num % den != 0 || fixed != (uint8_t)(num / den) || fabsf(f - (float)num / den) > .001f) {
+    return 0;
+  }
+  dcp_float_rounding++;
+  return 1;
+}
+
+static void test_dcp_levels(void) {
+  uint8_t levels, middle, l, x, fixed, expect;
+  uint16_t v;
+  float f;
+  int32_t num, den;
+
+  for (levels=1; levels<=42; levels++) {
+    middle = (levels - 1) / 2;
+    for (l=0; l<levels; l++) {
+      for (v=0; v<256; v++) {
+        x = v;
+        if (l > middle) {
+          fixed = (uint8_t)(((int16_t)(x - STOCK_BLADE_WHITE_RED) * (l * l)) / (levels * levels));
+          f = (x - STOCK_BLADE_WHITE_RED) * powf((float)l / levels, 2);
+          num = (int32_t)(x - STOCK_BLADE_WHITE_RED) * l * l;
+          den = levels * levels;
+          expect = to_u8(f);
+          CHECK(fixed == expect || dcp_rounding(fixed, f, num, den), "%u levels, level %u, %u toward white: %u, float gives %u", levels, l, x, (uint8_t)(x - fixed), (uint8_t)(x - expect));
+        } else if (l < middle) {
+          fixed = (uint8_t)(((uint16_t)x * ((l + 1) * (l + 1))) / ((middle + 1) * (middle + 1)));
+          f = x * powf((float)(l + 1) / (middle + 1), 2);
+          num = (int32_t)x * (l + 1) * (l + 1);
+          den = (middle + 1) * (middle + 1);
+          expect = to_u8(f);
+          CHECK(fixed == expect || dcp_rounding(fixed, f, num, den), "%u levels, level %u, %u darkened: %u, float gives %u", levels, l, x, fixed, expect);
+        }
+      }
+    }
+  }
+  printf("color picker levels: %u results where float fell short of a whole number\n", dcp_float_rounding);
+}
+
+int main(void) {
+  test_q16_mul8();
+  test_mul8_div255();
+  test_percent_to_u8();
+  test_flicker_dark();
+  test_dcp_levels();
+
+  if (failures != 0) {
+    printf("fixed_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("fixed_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,216 @@
+/* latency_test.c
+ *
+ * host simulation of the command-to-photon latency tracing (latency.c). micros() is a clock the test
+ * sets, and pwm_isr() does what the PWM ISR in pwm.c does when a new cycle starts, so commands can be
+ * walked through every stage at chosen times and the histogram checked.
+ *
+ * at the end it prints latency_dump() for a simulated run of commands, as the blade would over serial.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "latency.h"
+#include "millis.h"
+#include "serial.h"
+
+// state kept by latency.c
+extern uint8_t latency_stage;
+extern uint32_t latency_last[LATENCY_STAGES];
+extern uint8_t latency_last_cmd;
+extern uint8_t latency_histogram[16][LATENCY_BUCKETS];
+
+// stand-ins for the firmware latency.c talks to
+static uint32_t now = 0;
+
+uint32_t micros(void) {
+  return now;
+}
+
+char serial_buf[SERIAL_BUF_LEN];
+
+void serial_sendString(const char *s) {
+  fputs(s, stdout);
+}
+
+// the PWM ISR starting a new cycle; see pwm_handler() in pwm.c
+static void pwm_isr(void) {
+  if (latency_pwm_armed) {
+    latency_stage_time[LATENCY_STAGE_PWM] = micros();
+    latency_pwm_armed = 0;
+  }
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static void reset(void) {
+  memset(latency_histogram, 0, sizeof(latency_histogram));
+  memset(latency_last, 0, sizeof(latency_last));
+  latency_last_cmd = 0;
+  latency_stage = LATENCY_STAGES;
+  latency_pwm_armed = 0;
+}
+
+// walk cmd through every stage; edge is the time of its last data pin edge and each stage follows
+// the one before by step microseconds. the main loop passes after the PWM ISR records its stage
+static void trace(uint8_t cmd, uint32_t edge, uint32_t step) {
+  uint8_t stage;
+
+  latency_start(cmd, edge);
+  now = edge;
+  for (stage=LATENCY_STAGE_COMMAND; stage<LATENCY_STAGE_PWM; stage++) {
+    now += step;
+    latency_mark(stage);
+    latency_handler();
+  }
+  now += step;
+  pwm_isr();
+  latency_handler();
+}
+
+// the bucket of the last trace of cmd, or LATENCY_BUCKETS if none was counted
+static uint8_t bucket_of(uint8_t cmd) {
+  uint8_t b;
+
+  for (b=0; b<LATENCY_BUCKETS; b++) {
+    if (latency_histogram[cmd >> 4][b] != 0) {
+      return b;
+    }
+  }
+  return LATENCY_BUCKETS;
+}
+
+// bucket 0 is under 512uS, each bucket after that doubles and the last holds everything above
+static void test_buckets(void) {
+  static const struct {
+    uint32_t total;
+    uint8_t bucket;
+  } cases[] = {
+    {0, 0}, {508, 0}, {512, 1}, {1020, 1}, {1024, 2}, {2044, 2}, {2048, 3},
+    {32764, 6}, {32768, 7}, {10000000, 7}
+  };
+  uint8_t i, b;
+
+  for (i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+    reset();
+    trace(0x20, 1000, cases[i].total / 4);
+    b = bucket_of(0x20);
+    CHECK(b == cases[i].bucket, "%luuS should count in bucket %u, counted in %u", (unsigned long)cases[i].total, cases[i].bucket, b);
+    CHECK(latency_last[LATENCY_STAGE_PWM] - latency_last[LATENCY_STAGE_EDGE] == cases[i].total, "total should be %luuS", (unsigned long)cases[i].total);
+  }
+
+  // the total is taken modulo 2^32, so a trace across micros() wrapping still lands in its bucket
+  reset();
+  trace(0x20, 0xFFFFFF00, 0x100);
+  CHECK(bucket_of(0x20) == 2, "a 1024uS trace across micros() wrapping should count in bucket 2, counted in %u", bucket_of(0x20));
+}
+
+// the last trace is kept with its command, and each command's high nibble has its own histogram row
+static void test_last(void) {
+  reset();
+  trace(0x41, 5000, 100);
+  trace(0xA3, 9000, 300);
+  CHECK(latency_last_cmd == 0xA3, "last command should be A3, was %02X", latency_last_cmd);
+  CHECK(latency_last[LATENCY_STAGE_EDGE] == 9000 && latency_last[LATENCY_STAGE_COMMAND] == 9300 && latency_last[LATENCY_STAGE_PWM] == 10200, "last trace has the wrong stage times");
+  CHECK(bucket_of(0x41) == 0 && bucket_of(0xA3) == 2, "commands 41 and A3 should count in buckets 0 and 2 of their own rows");
+  CHECK(bucket_of(0x00) == LATENCY_BUCKETS, "nothing should count in the row of commands 00-0F");
+}
+
+// stages are only recorded in order and once, and nothing is counted until the PWM ISR has run
+static void test_order(void) {
+  reset();
+  latency_start(0x30, 0);
+
+  now = 100;
+  latency_mark(LATENCY_STAGE_ANIMATE);       // out of order
+  CHECK(latency_stage == LATENCY_STAGE_COMMAND, "a stage reached out of order should be ignored");
+  latency_mark(LATENCY_STAGE_COMMAND);
+  now = 200;
+  latency_mark(LATENCY_STAGE_COMMAND);       // again
+  CHECK(latency_stage_time[LATENCY_STAGE_COMMAND] == 100, "a stage should only be recorded the first time it's reached");
+
+  now = 300;
+  latency_mark(LATENCY_STAGE_ANIMATE);
+  pwm_isr();                                 // brightness not published yet
+  latency_handler();
+  CHECK(latency_pwm_armed == 0 && latency_stage == LATENCY_STAGE_BRIGHTNESS, "the PWM ISR shouldn't record before brightness is published");
+
+  now = 400;
+  latency_mark(LATENCY_STAGE_BRIGHTNESS);
+  latency_handler();                         // PWM ISR hasn't run yet
+  CHECK(latency_pwm_armed == 1 && bucket_of(0x30) == LATENCY_BUCKETS, "nothing should be counted before the PWM ISR records its stage");
+
+  now = 600;
+  pwm_isr();
+  latency_handler();
+  CHECK(bucket_of(0x30) == 1 && latency_stage == LATENCY_STAGES, "600uS trace should count in bucket 1");
+
+  // once counted, nothing more is recorded until the next command
+  now = 900;
+  latency_mark(LATENCY_STAGE_COMMAND);
+  pwm_isr();
+  latency_handler();
+  CHECK(latency_histogram[0x30 >> 4][1] == 1 && latency_stage_time[LATENCY_STAGE_COMMAND] == 100, "marks with nothing being traced should be ignored");
+
+  // a command arriving mid-trace replaces the one being traced
+  latency_start(0x31, 1000);
+  now = 1100;
+  latency_mark(LATENCY_STAGE_COMMAND);
+  now = 1200;
+  latency_mark(LATENCY_STAGE_ANIMATE);
+  latency_start(0x52, 1300);
+  CHECK(latency_pwm_armed == 0 && latency_stage == LATENCY_STAGE_COMMAND, "a new command should restart the trace");
+}
+
+// counts stop at 0xFF instead of wrapping
+static void test_saturate(void) {
+  uint16_t i;
+
+  reset();
+  for (i=0; i<300; i++) {
+    trace(0x70, i * 10000UL, 50);
+  }
+  CHECK(latency_histogram[0x70 >> 4][0] == 0xFF, "300 traces should saturate at 255, count is %u", latency_histogram[0x70 >> 4][0]);
+}
+
+// a run of commands with made-up, spread out stage times, to show what latency_dump() reports. these
+// aren't measurements; trace a blade with LATENCY_TRACE_ENABLED for those
+static void simulate(void) {
+  static const uint8_t cmds[] = {0x10, 0x20, 0x21, 0x40, 0x41, 0x50, 0xA0, 0xC3};
+  uint32_t edge = 0;
+  uint16_t i;
+  uint8_t stage;
+
+  reset();
+  for (i=0; i<400; i++) {
+    edge += 50000 + (i * 7919UL) % 20000;
+    latency_start(cmds[i % sizeof(cmds)], edge);
+    now = edge + 20 + (i * 37) % 900;
+    for (stage=LATENCY_STAGE_COMMAND; stage<LATENCY_STAGE_PWM; stage++) {
+      latency_mark(stage);
+      now += 150 + (i * 131) % ((stage == LATENCY_STAGE_ANIMATE) ? 5000 : 400);
+    }
+    now += (i * 53) % 2000;
+    pwm_isr();
+    latency_handler();
+  }
+  printf("simulated run of %u commands:\n", i);
+  latency_dump();
+}
+
+int main(void) {
+  test_buckets();
+  test_last();
+  test_order();
+  test_saturate();
+  simulate();
+
+  if (failures != 0) {
+    printf("latency_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("latency_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,113 @@
+/* rng_test.c
+ *
+ * host test of the pseudo-random number generator (rng.c) and the lattice hash of the value noise
+ * (noise.c): the generator's period, how evenly rng_range() spreads its values over one period, and
+ * that every lattice value appears once per 256 points.
+ *
+ * noise.c is included whole since its lattice hash is static.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rng.h"
+#include "noise.c"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// the generator visits every value but 0 once before repeating, from any seed
+static void test_period(void) {
+  static uint8_t seen[65536];
+  static const uint16_t seeds[] = {0, 1, 0xACE1, 0x8000, 0xFFFF};
+  uint32_t period, repeats;
+  uint16_t first, r;
+  uint8_t i;
+
+  for (i=0; i<sizeof(seeds)/sizeof(seeds[0]); i++) {
+    memset(seen, 0, sizeof(seen));
+    rng_seed(seeds[i]);
+    first = rng16();
+    r = first;
+    period = 0;
+    repeats = 0;
+    do {
+      repeats += seen[r];
+      seen[r] = 1;
+      period++;
+      r = rng16();
+    } while (r != first && period < 70000);
+    CHECK(period == 65535, "seed %04X: period is %lu, should be 65535", seeds[i], (unsigned long)period);
+    CHECK(repeats == 0 && seen[0] == 0, "seed %04X: a value repeated or 0 came up within the period", seeds[i]);
+  }
+}
+
+// over one period, rng_range(n) stays below n, and the most common value comes up less than 0.4% more
+// often than the least common one, for every n
+static void test_range(void) {
+  static uint16_t count[256];
+  uint16_t n, v, lo, hi;
+  uint32_t i;
+  double bias, worst = 0;
+  uint16_t worst_n = 0;
+
+  for (n=1; n<256; n++) {
+    memset(count, 0, sizeof(count));
+    rng_seed(1);
+    for (i=0; i<65535; i++) {
+      v = rng_range(n);
+      if (v >= n) {
+        CHECK(0, "rng_range(%u) returned %u", n, v);
+        break;
+      }
+      count[v]++;
+    }
+    lo = 0xFFFF;
+    hi = 0;
+    for (v=0; v<n; v++) {
+      if (count[v] < lo) {
+        lo = count[v];
+      }
+      if (count[v] > hi) {
+        hi = count[v];
+      }
+    }
+    bias = (double)(hi - lo) / lo;
+    CHECK(bias < .004, "rng_range(%u): values came up %u to %u times, a bias of %.2f%%", n, lo, hi, bias * 100);
+    if (bias > worst) {
+      worst = bias;
+      worst_n = n;
+    }
+  }
+  CHECK(rng_range(0) == 0, "rng_range(0) should return 0");
+  printf("rng_range: worst bias %.3f%%, at n = %u\n", worst * 100, worst_n);
+}
+
+// the lattice hash is a bijection on 8 bits, so noise8() repeats every 256 lattice points and no value
+// is favored
+static void test_lattice(void) {
+  uint8_t seen[256];
+  uint16_t i;
+
+  memset(seen, 0, sizeof(seen));
+  for (i=0; i<256; i++) {
+    seen[noise_lattice(i)]++;
+  }
+  for (i=0; i<256; i++) {
+    CHECK(seen[i] == 1, "lattice value %u comes up %u times in 256 points", i, seen[i]);
+  }
+}
+
+int main(void) {
+  test_period();
+  test_range();
+  test_lattice();
+
+  if (failures != 0) {
+    printf("rng_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("rng_test: ok\n");
+  return 0;
+}
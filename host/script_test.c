@@ -0,0 +1,278 @@
+/* script_test.c
+ *
+ * host regression test for the effect script interpreter (script.c). the script area is an array
+ * standing in for EEPROM and fade_segment_color() records what it's asked to do instead of fading.
+ *
+ * it also reports the most work the interpreter does in one frame, counted in instructions, EEPROM
+ * reads and color changes. cycles per frame depend on the AVR and can only be measured on the blade
+ * (or a cycle-accurate simulator); these counts are what those cycles are spent on.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include "blade_state.h"
+#include "eeprom.h"
+#include "fixed.h"
+#include "fade.h"
+#include "frame.h"
+#include "script.h"
+
+// stand-ins for the firmware the interpreter talks to
+static uint8_t eeprom[EEPROM_SCRIPT_ADDR + EEPROM_SCRIPT_LEN];
+static uint16_t eeprom_reads = 0;
+
+uint8_t segment_brightness[BLADE_SEGMENTS];
+uint8_t segment_dirty = 0;
+
+static uint8_t color[BLADE_SEGMENTS][RGB_SIZE];    // the last color each segment was given
+static uint16_t color_time[BLADE_SEGMENTS];        // and the fade time it was given with
+static uint16_t color_calls = 0;
+
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+  eeprom_reads++;
+  return eeprom[(uintptr_t)addr];
+}
+
+void fade_segment_color(uint8_t segment, uint8_t red, uint8_t green, uint8_t blue, uint16_t duration) {
+  color[segment][RED_IDX] = red;
+  color[segment][GRN_IDX] = green;
+  color[segment][BLU_IDX] = blue;
+  color_time[segment] = duration;
+  color_calls++;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// red as script_color() stores it
+#define RED_FULL q16_mul8(255, RED_ADJUST)
+
+// replace the script area with code; the rest reads as SCRIPT_OP_END
+static void load(const uint8_t *code, uint8_t len) {
+  memset(eeprom, 0, sizeof(eeprom));
+  memcpy(&eeprom[EEPROM_SCRIPT_ADDR], code, len);
+  memset(color, 0, sizeof(color));
+  memset(color_time, 0, sizeof(color_time));
+  memset(segment_brightness, 0, sizeof(segment_brightness));
+}
+
+static uint8_t is_color(uint8_t s, uint8_t red, uint8_t green, uint8_t blue) {
+  return color[s][RED_IDX] == red && color[s][GRN_IDX] == green && color[s][BLU_IDX] == blue;
+}
+
+// the example from the README; the halves of the blade swap between red and blue every 200ms
+static void test_example(void) {
+  static const uint8_t code[] = {
+    0x70, 0x00,
+    0x13, 0xFF, 0x00, 0x00,
+    0x1C, 0x00, 0x00, 0xFF,
+    0x60, 0x14,
+    0x13, 0x00, 0x00, 0xFF,
+    0x1C, 0xFF, 0x00, 0x00,
+    0x60, 0x14,
+    0x80,
+    0x00
+  };
+  uint16_t t;
+  uint8_t first_half;
+
+  load(code, sizeof(code));
+  script_select(0);
+  for (t=0; t<2000; t+=FRAME_PERIOD) {
+    script_run((t == 0) ? 0 : FRAME_PERIOD);
+
+    // the script was last run at t, so the colors it set belong to the 200ms period t falls in
+    first_half = ((t / 200) % 2) == 0;
+    if (first_half) {
+      CHECK(is_color(0, RED_FULL, 0, 0) && is_color(1, RED_FULL, 0, 0), "t=%u: segments 1-2 should be red", t);
+      CHECK(is_color(2, 0, 0, 255) && is_color(3, 0, 0, 255), "t=%u: segments 3-4 should be blue", t);
+    } else {
+      CHECK(is_color(0, 0, 0, 255) && is_color(1, 0, 0, 255), "t=%u: segments 1-2 should be blue", t);
+      CHECK(is_color(2, RED_FULL, 0, 0) && is_color(3, RED_FULL, 0, 0), "t=%u: segments 3-4 should be red", t);
+    }
+  }
+}
+
+// FADE passes its time, in SCRIPT_TIME_UNITs, to the crossfade
+static void test_fade(void) {
+  static const uint8_t code[] = {
+    0x25, 0x00, 0xFF, 0x00, 0x0A,   // segments 1 and 3 fade to green over 100ms
+    0x60, 0x32,                     // wait 500ms
+    0x00
+  };
+
+  load(code, sizeof(code));
+  script_select(0);
+  script_run(FRAME_PERIOD);
+  CHECK(is_color(0, 0, 255, 0) && is_color(2, 0, 255, 0), "segments 1 and 3 should fade to green");
+  CHECK(color_time[0] == 10 * SCRIPT_TIME_UNIT && color_time[2] == 10 * SCRIPT_TIME_UNIT, "fade time should be %u, was %u", 10 * SCRIPT_TIME_UNIT, color_time[0]);
+  CHECK(is_color(1, 0, 0, 0) && is_color(3, 0, 0, 0), "segments 2 and 4 are not in the mask");
+}
+
+// a WAIT lasts its time however long the frames are. the script starts at t=0, so the first run has
+// no time to account for
+static void test_wait(void) {
+  static const uint8_t code[] = {
+    0x4F, 0x10,   // all segments to 16
+    0x60, 0x14,   // wait 200ms
+    0x4F, 0x20,   // all segments to 32
+    0x60, 0xFF,
+    0x00
+  };
+  static const uint8_t dts[] = {1, 5, 15, 50};
+  uint8_t i;
+  uint16_t t;
+
+  for (i=0; i<sizeof(dts); i++) {
+    load(code, sizeof(code));
+    script_select(0);
+    for (t=0; t < 1000; t+=dts[i]) {
+      script_run((t == 0) ? 0 : dts[i]);
+      if (segment_brightness[0] == 32) {
+        break;
+      }
+    }
+    CHECK(t >= 200 && t < 200 + dts[i], "dt=%u: a 200ms wait ended at %ums", dts[i], t);
+  }
+}
+
+// WAITs that end part way through a frame don't add up to drift
+static void test_drift(void) {
+  static const uint8_t code[] = {
+    0x70, 0x00,
+    0x4F, 0x10,   // level 16
+    0x60, 0x07,   // wait 70ms
+    0x4F, 0x20,   // level 32
+    0x60, 0x07,   // wait 70ms
+    0x80,
+    0x00
+  };
+  uint16_t t, changes = 0;
+  uint8_t last;
+
+  load(code, sizeof(code));
+  script_select(0);
+  script_run(0);
+  last = segment_brightness[0];
+  for (t=15; t < 7000 + 15; t+=15) {
+    script_run(15);
+    if (segment_brightness[0] != last) {
+      last = segment_brightness[0];
+      changes++;
+    }
+  }
+  CHECK(changes == 100, "100 70ms waits should end by the first 15ms frame after 7 seconds; got %u", changes);
+}
+
+// script_select() skips over scripts to the one asked for, and falls back to the first
+static void test_select(void) {
+  static const uint8_t code[] = {
+    0x4F, 0x01, 0x00,
+    0x4F, 0x02, 0x00,
+    0x4F, 0x03, 0x00
+  };
+  uint8_t n;
+
+  for (n=0; n<5; n++) {
+    load(code, sizeof(code));
+    script_select(n);
+    script_run(FRAME_PERIOD);
+    CHECK(segment_brightness[0] == ((n < 3) ? n + 1 : 1), "script %u set level %u", n, segment_brightness[0]);
+  }
+}
+
+// LOOP counts, and nesting past SCRIPT_LOOP_DEPTH restarts the script
+static void test_loops(void) {
+  static const uint8_t counted[] = {
+    0x70, 0x03,       // 3 times
+    0x70, 0x02,       //   2 times
+    0x5F, 0x00, 0xFF, //     random level
+    0x60, 0x01,       //     wait 10ms
+    0x80,
+    0x80,
+    0x4F, 0xAA,       // then level 0xAA
+    0x60, 0xFF,
+    0x00
+  };
+  static const uint8_t too_deep[] = {
+    0x70, 0x00, 0x70, 0x00, 0x70, 0x00, 0x4F, 0x55, 0x80, 0x80, 0x80, 0x00
+  };
+  uint16_t t;
+
+  load(counted, sizeof(counted));
+  script_select(0);
+  for (t=0; t < 1000; t+=FRAME_PERIOD) {
+    script_run((t == 0) ? 0 : FRAME_PERIOD);
+    if (segment_brightness[0] == 0xAA) {
+      break;
+    }
+  }
+  CHECK(t == 60, "3 x 2 passes of a 10ms wait ended at %ums", t);
+
+  load(too_deep, sizeof(too_deep));
+  script_select(0);
+  for (t=0; t<100; t+=FRAME_PERIOD) {
+    script_run(FRAME_PERIOD);
+  }
+  CHECK(segment_brightness[0] == 0, "loops nested %u deep should never reach their body", SCRIPT_LOOP_DEPTH + 1);
+}
+
+// the most work done in one frame; a script that never waits runs SCRIPT_BUDGET instructions a frame
+static void bench(void) {
+  static const uint8_t fades[] = {
+    0x70, 0x00,
+    0x2F, 0x10, 0x20, 0x30, 0x01,   // FADE of all 4 segments; the most expensive instruction
+    0x80,
+    0x00
+  };
+  static const uint8_t levels[] = {
+    0x70, 0x00,
+    0x5F, 0x00, 0xFF,               // RAND_LEVEL of all 4 segments
+    0x80,
+    0x00
+  };
+  const uint8_t *code[] = {fades, levels};
+  const uint8_t len[] = {sizeof(fades), sizeof(levels)};
+  const char *name[] = {"FADE loop", "RAND_LEVEL loop"};
+  uint16_t reads, calls, max_reads, max_calls, frame;
+  uint8_t i;
+
+  for (i=0; i<2; i++) {
+    load(code[i], len[i]);
+    script_select(0);
+    max_reads = max_calls = 0;
+    for (frame=0; frame<100; frame++) {
+      reads = eeprom_reads;
+      calls = color_calls;
+      script_run(FRAME_PERIOD);
+      reads = eeprom_reads - reads;
+      calls = color_calls - calls;
+      max_reads = (reads > max_reads) ? reads : max_reads;
+      max_calls = (calls > max_calls) ? calls : max_calls;
+    }
+    printf("  %-16s worst frame: %2u EEPROM reads, %2u segment color changes (budget %u instructions)\n", name[i], max_reads, max_calls, SCRIPT_BUDGET);
+    CHECK(max_calls <= SCRIPT_BUDGET * BLADE_SEGMENTS, "more color changes in a frame than the budget allows");
+  }
+}
+
+int main(void) {
+  test_example();
+  test_fade();
+  test_wait();
+  test_drift();
+  test_select();
+  test_loops();
+
+  printf("script interpreter:\n");
+  bench();
+
+  if (failures != 0) {
+    printf("script_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("script_test: ok\n");
+  return 0;
+}
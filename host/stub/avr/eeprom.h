@@ -0,0 +1,15 @@
+/* avr/eeprom.h
+ *
+ * host stand-in for avr-libc's EEPROM access; each harness provides eeprom_read_byte() over its own
+ * array, indexed by EEPROM address
+ *
+ */
+
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+
+#endif /* HOST_AVR_EEPROM_H_ */
@@ -0,0 +1,34 @@
+/* hsv.c
+ *
+ * HSV to RGB; see hsv.h
+ *
+ * hue * 6 splits the wheel into 6 sectors; the top byte is the sector and the next byte is how far
+ * through it the hue is. within a sector one channel sits at value, one at the minimum (p), and
+ * one ramps between them (q falling, t rising). a call is one 16x8 multiply and at most 5
+ * mul8_div255()s
+ *
+ */
+
+#include <stdint.h>
+#include "blade_state.h"
+#include "fixed.h"
+#include "hsv.h"
+
+void hsv_to_rgb(uint16_t hue, uint8_t sat, uint8_t val, uint8_t *rgb) {
+  uint32_t sextant = (uint32_t)hue * 6;
+  uint8_t frac = (uint8_t)(sextant >> 8);
+  uint8_t p, q, t;
+
+  p = mul8_div255(val, 255 - sat);
+  q = mul8_div255(val, 255 - mul8_div255(sat, frac));
+  t = mul8_div255(val, 255 - mul8_div255(sat, 255 - frac));
+
+  switch ((uint8_t)(sextant >> 16)) {
+    case 0:  rgb[RED_IDX] = val; rgb[GRN_IDX] = t;   rgb[BLU_IDX] = p;   break;
+    case 1:  rgb[RED_IDX] = q;   rgb[GRN_IDX] = val; rgb[BLU_IDX] = p;   break;
+    case 2:  rgb[RED_IDX] = p;   rgb[GRN_IDX] = val; rgb[BLU_IDX] = t;   break;
+    case 3:  rgb[RED_IDX] = p;   rgb[GRN_IDX] = q;   rgb[BLU_IDX] = val; break;
+    case 4:  rgb[RED_IDX] = t;   rgb[GRN_IDX] = p;   rgb[BLU_IDX] = val; break;
+    default: rgb[RED_IDX] = val; rgb[GRN_IDX] = p;   rgb[BLU_IDX] = q;   break;
+  }
+}
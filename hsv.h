@@ -0,0 +1,28 @@
+/* hsv.h
+ *
+ * integer HSV to RGB conversion. hue is 16 bits, so a color wheel can move in steps far finer than
+ * a blade can show; saturation and value are 8 bits. no tables and no division.
+ *
+ */ 
+
+#ifndef HSV_H_
+#define HSV_H_
+
+// hue values of the primary colors; the wheel runs red, yellow, green, cyan, blue, magenta and back to red
+#define HSV_HUE_RED     0
+#define HSV_HUE_GREEN   21845
+#define HSV_HUE_BLUE    43691
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// convert hue (0-65535), saturation (0-255) and value (0-255) to red, green and blue values,
+// stored in rgb[RED_IDX], rgb[GRN_IDX] and rgb[BLU_IDX]
+void hsv_to_rgb(uint16_t hue, uint8_t sat, uint8_t val, uint8_t *rgb);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* HSV_H_ */
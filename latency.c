@@ -0,0 +1,91 @@
+/* latency.c
+ *
+ * Command-to-photon latency instrumentation. See latency.h.
+ */
+
+#include <stdio.h>
+#include "latency.h"
+#include "millis.h"
+#include "serial.h"
+
+#ifdef LATENCY_TRACE_ENABLED
+
+volatile uint8_t latency_pwm_armed = 0;
+volatile uint32_t latency_stage_time[LATENCY_STAGES];
+
+uint8_t latency_cmd = 0;                        // command being traced
+uint8_t latency_stage = LATENCY_STAGES;         // next stage expected; LATENCY_STAGES = nothing being traced
+uint32_t latency_last[LATENCY_STAGES];          // stage timestamps of the last completed trace
+uint8_t latency_last_cmd = 0;
+uint8_t latency_histogram[16][LATENCY_BUCKETS]; // saturating counts, indexed by command high nibble and bucket
+
+void latency_start(uint8_t cmd, uint32_t edge_time) {
+  latency_pwm_armed = 0;
+  latency_cmd = cmd;
+  latency_stage_time[LATENCY_STAGE_EDGE] = edge_time;
+  latency_stage = LATENCY_STAGE_COMMAND;
+}
+
+void latency_mark(uint8_t stage) {
+
+  // only record stages in order, and only once per trace
+  if (stage == latency_stage) {
+    latency_stage_time[stage] = micros();
+    latency_stage++;
+
+    // hand the last stage over to the PWM ISR
+    if (latency_stage == LATENCY_STAGE_PWM) {
+      latency_pwm_armed = 1;
+    }
+  }
+}
+
+void latency_handler(void) {
+  uint8_t i, bucket;
+  uint32_t total;
+
+  // the PWM ISR clears latency_pwm_armed once it has recorded its timestamp
+  if (latency_stage == LATENCY_STAGE_PWM && latency_pwm_armed == 0) {
+    for (i=0; i<LATENCY_STAGES; i++) {
+      latency_last[i] = latency_stage_time[i];
+    }
+    latency_last_cmd = latency_cmd;
+    latency_stage = LATENCY_STAGES;
+
+    // bucket 0 is under (1 << LATENCY_BUCKET_SHIFT) microseconds, each bucket after that doubles
+    total = (latency_last[LATENCY_STAGE_PWM] - latency_last[LATENCY_STAGE_EDGE]) >> LATENCY_BUCKET_SHIFT;
+    for (bucket=0; total != 0 && bucket < (LATENCY_BUCKETS - 1); bucket++) {
+      total >>= 1;
+    }
+    if (latency_histogram[latency_cmd >> 4][bucket] != 0xFF) {
+      latency_histogram[latency_cmd >> 4][bucket]++;
+    }
+  }
+}
+
+#ifdef DEBUG_SERIAL_ENABLED
+void latency_dump(void) {
+  uint8_t i, b;
+
+  serial_sendString("LATENCY:\r\n");
+  snprintf(serial_buf, SERIAL_BUF_LEN, "  last cmd %02X, uS after edge:", latency_last_cmd);
+  serial_sendString(serial_buf);
+  for (i=1; i<LATENCY_STAGES; i++) {
+    snprintf(serial_buf, SERIAL_BUF_LEN, " %lu", (unsigned long)(latency_last[i] - latency_last[LATENCY_STAGE_EDGE]));
+    serial_sendString(serial_buf);
+  }
+  serial_sendString("\r\n  cmd  <.5ms  <1ms  <2ms  <4ms  <8ms <16ms <32ms  more\r\n");
+  for (i=0; i<16; i++) {
+    snprintf(serial_buf, SERIAL_BUF_LEN, "  %X0 ", i);
+    serial_sendString(serial_buf);
+    for (b=0; b<LATENCY_BUCKETS; b++) {
+      snprintf(serial_buf, SERIAL_BUF_LEN, " %5u", latency_histogram[i][b]);
+      serial_sendString(serial_buf);
+    }
+    serial_sendString("\r\n");
+  }
+  serial_sendString("\r\n");
+}
+#endif
+
+#endif
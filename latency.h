@@ -0,0 +1,65 @@
+/* latency.h
+ *
+ * Optional instrumentation that measures how long it takes a command from the hilt to show up on
+ * the blade. Each command is timestamped as it passes through the stages below. When the PWM ISR
+ * applies the result, the total latency is added to a per-command histogram.
+ *
+ * Comment out LATENCY_TRACE_ENABLED to remove the instrumentation from the firmware.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+//#define LATENCY_TRACE_ENABLED
+
+// stages a command passes through on its way to the LEDs
+#define LATENCY_STAGE_EDGE        0   // last data pin edge of the command, recorded by the data pin ISR
+#define LATENCY_STAGE_COMMAND     1   // command picked up by command_handler()
+#define LATENCY_STAGE_ANIMATE     2   // animate_handler() and dmode_handler() have run
+#define LATENCY_STAGE_BRIGHTNESS  3   // true_segment_brightness_handler() has published new brightness values
+#define LATENCY_STAGE_PWM         4   // the PWM ISR has started a new cycle with the published values
+#define LATENCY_STAGES            5
+
+// histogram buckets; bucket 0 is under 512uS, each bucket after that doubles, the last bucket holds everything above
+#define LATENCY_BUCKETS           8
+#define LATENCY_BUCKET_SHIFT      9
+
+#ifdef LATENCY_TRACE_ENABLED
+  #define LATENCY_MARK(STAGE) latency_mark(STAGE)
+#else
+  #define LATENCY_MARK(STAGE) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef LATENCY_TRACE_ENABLED
+
+// GLOBAL: latency_pwm_armed - set once brightness has been published; cleared by the PWM ISR when it records LATENCY_STAGE_PWM
+extern volatile uint8_t latency_pwm_armed;
+
+// GLOBAL: latency_stage_time - timestamps, in microseconds, of each stage for the command currently being traced
+extern volatile uint32_t latency_stage_time[LATENCY_STAGES];
+
+// start tracing a command; edge_time is the time of the command's last data pin edge
+void latency_start(uint8_t cmd, uint32_t edge_time);
+
+// record the time a stage was reached by the command being traced
+void latency_mark(uint8_t stage);
+
+// add completed traces to the histogram; call once per pass through the main loop
+void latency_handler(void);
+
+#ifdef DEBUG_SERIAL_ENABLED
+// dump the last trace and the latency histograms to serial
+void latency_dump(void);
+#endif
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* LATENCY_H_ */
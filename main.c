@@ -13,7 +13,12 @@
 #include "device_config.h"
 #include "blade_state.h"
 #include "data.h"
+#include "eeprom.h"
 #include "dmode_handler.h"
+#include "latency.h"
+#include "frame.h"
+#include "fade.h"
+#include "render.h"
 
 // program setup
 void setup() {
@@ -26,7 +31,11 @@ void loop() {
     sleep_handler();          // put the blade to sleep if it's been off for X number of seconds
     data_handler();           // read data from DATA_PIN
   }
+  eeprom_handler();           // write any stored settings to EEPROM in the background
   command_handler();          // process command data
+  dmode_desc_handler();       // decode any change to the display settings for the handlers below
+  frame_handler();            // advance the effect frame clock
+  fade_handler();             // blend segment colors toward their fade targets; keeps running while off so fades always finish
 
   // only call animate and dmode handlers if blade is not off
   if ((blade.state & 0xF0) != BLADE_STATE_OFF) {
@@ -36,6 +45,9 @@ void loop() {
     if (switch_config ^ (1<<SW_DMODE_DISABLE_bp)) {
       dmode_handler();        // adds custom colors and effects to the blade
     }
+    LATENCY_MARK(LATENCY_STAGE_ANIMATE);
+
+    render_handler();         // composite base colors and any overlay into the colors pwm_handler() displays
 
     // calculate the true brightness of each segment
     //
@@ -45,7 +57,12 @@ void loop() {
     // it's a lot of effort, but doing this allows animation effects to persist through
     // ignition and extinguish, making the effects much cleaner.
     true_segment_brightness_handler();
+    LATENCY_MARK(LATENCY_STAGE_BRIGHTNESS);
   }
+
+  #ifdef LATENCY_TRACE_ENABLED
+    latency_handler();        // collect completed command latency measurements
+  #endif
 }
 
 // main program
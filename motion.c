@@ -0,0 +1,27 @@
+/* motion.c
+ *
+ * sub-segment motion; see motion.h
+ *
+ */
+
+#include <stdint.h>
+#include "blade_state.h"
+#include "motion.h"
+
+// level + add, saturating at 255
+static uint8_t motion_add(uint8_t level, uint8_t add) {
+  return (add > 255 - level) ? 255 : level + add;
+}
+
+void motion_light(uint8_t *level, uint16_t pos, uint8_t intensity) {
+  uint8_t s = pos >> 8;                                         // the light sits between segments s - 1 and s
+  uint8_t upper = ((uint16_t)intensity * (pos & 0xFF)) >> 8;    // share of the light given to segment s
+  uint8_t lower = intensity - upper;                            // and to segment s - 1
+
+  if (s >= 1 && s <= BLADE_SEGMENTS) {
+    level[s - 1] = motion_add(level[s - 1], lower);
+  }
+  if (s < BLADE_SEGMENTS) {
+    level[s] = motion_add(level[s], upper);
+  }
+}
@@ -0,0 +1,31 @@
+/* motion.h
+ *
+ * sub-segment motion for a blade with only BLADE_SEGMENTS physical segments. an effect places a light
+ * at a fractional position along the blade and its brightness is split between the two nearest
+ * segments, so it glides from one segment to the next instead of jumping a whole segment at a time.
+ *
+ * positions are Q8.8 values in segments. segment s is centred on MOTION_POS(s); position 0 is one
+ * segment below the base of the blade and MOTION_POS_END is one segment past the tip, so a light can
+ * slide onto and off of the blade smoothly.
+ *
+ */
+
+#ifndef MOTION_H_
+#define MOTION_H_
+
+#define MOTION_POS(s)   ((uint16_t)((s) + 1) << 8)      // the position of the centre of segment s
+#define MOTION_POS_END  MOTION_POS(BLADE_SEGMENTS)      // one segment past the tip of the blade
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// add a light of the given intensity (0-255) at pos to level[], splitting it between the two segments
+// on either side of pos. levels saturate at 255
+void motion_light(uint8_t *level, uint16_t pos, uint8_t intensity);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* MOTION_H_ */
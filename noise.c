@@ -0,0 +1,39 @@
+/* noise.c
+ *
+ * 1D value noise; see noise.h
+ *
+ */
+
+#include <stdint.h>
+#include "noise.h"
+
+// pseudo-random value for a lattice point. a bijective 8-bit hash, so every value appears once per 256 points
+static uint8_t noise_lattice(uint8_t i) {
+  uint8_t h = (uint8_t)(i * 151 + 89);
+
+  h ^= h >> 4;
+  h = (uint8_t)(h * 109);
+  h ^= h >> 3;
+  return h;
+}
+
+uint8_t noise8(uint16_t position) {
+  uint8_t a = noise_lattice(position >> 8);
+  uint8_t b = noise_lattice((position >> 8) + 1);
+  uint8_t f = position & 0xFF;
+  uint16_t ff, s;
+
+  // smoothstep the fraction, 3f^2 - 2f^3, scaled so s runs from 0 to 256
+  ff = ((uint16_t)f * f) >> 8;
+  s = (ff * 3) - ((ff * f) >> 7);
+
+  // interpolate between the lattice values
+  if (b >= a) {
+    return a + (uint8_t)(((uint16_t)(b - a) * s) >> 8);
+  }
+  return a - (uint8_t)(((uint16_t)(a - b) * s) >> 8);
+}
+
+uint8_t noise8_fbm(uint16_t position) {
+  return (uint8_t)(((uint16_t)noise8(position) * 3 + noise8((position << 1) + 0x8000)) >> 2);
+}
@@ -0,0 +1,32 @@
+/* noise.h
+ *
+ * fixed-point 1D value noise for organic flicker effects. integer math only.
+ *
+ * positions are Q8.8 values: the high byte selects a point on a lattice of pseudo-random values
+ * and the low byte is the fraction of the way to the next point. noise is smoothly interpolated
+ * between lattice points and repeats every 256 points. advance the position a little each frame
+ * for a slowly wandering value; give each segment its own offset into the lattice (see
+ * NOISE_SEGMENT_PHASE) for independent but similar-looking channels.
+ *
+ */ 
+
+#ifndef NOISE_H_
+#define NOISE_H_
+
+#define NOISE_SEGMENT_PHASE 0x3B00  // lattice offset between segment channels; far enough apart to be unrelated
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// value noise at the given position; returns 0-255
+uint8_t noise8(uint16_t position);
+
+// two octaves of value noise, the second at twice the frequency and a quarter of the weight; returns 0-255
+uint8_t noise8_fbm(uint16_t position);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* NOISE_H_ */
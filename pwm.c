@@ -6,6 +6,9 @@
 #include <avr/interrupt.h>
 #include "blade_state.h"
 #include "pwm.h"
+#include "render.h"
+#include "millis.h"
+#include "latency.h"
 
 // keep track of current blade color bit depth reduction
 volatile uint8_t color_derez = SINGLE_COLOR_DEREZ;
@@ -48,21 +51,29 @@ ISR(TCA0_LUNF_vect) {
     if (color_derez != SINGLE_COLOR_DEREZ || current_segment == 0) {
 
       // set the current segment's color;
-      if ( RED_VAL != DEREZ(segment_color[current_segment][RED_IDX])
-        || GRN_VAL != DEREZ(segment_color[current_segment][GRN_IDX])
-        || BLU_VAL != DEREZ(segment_color[current_segment][BLU_IDX])
+      if ( RED_VAL != DEREZ(render_color[current_segment][RED_IDX])
+        || GRN_VAL != DEREZ(render_color[current_segment][GRN_IDX])
+        || BLU_VAL != DEREZ(render_color[current_segment][BLU_IDX])
       ) {
 
         // calculate new RGB values and store them for later
-        r = DEREZ(segment_color[current_segment][RED_IDX]);
-        g = DEREZ(segment_color[current_segment][GRN_IDX]);
-        b = DEREZ(segment_color[current_segment][BLU_IDX]);
+        r = DEREZ(render_color[current_segment][RED_IDX]);
+        g = DEREZ(render_color[current_segment][GRN_IDX]);
+        b = DEREZ(render_color[current_segment][BLU_IDX]);
 
         // set status flag
         status = 1;
       }
     }
     last_segment = current_segment;
+
+    // a new PWM cycle is starting with the most recently published brightness values
+    #ifdef LATENCY_TRACE_ENABLED
+      if (current_segment == 0 && latency_pwm_armed) {
+        latency_stage_time[LATENCY_STAGE_PWM] = micros();
+        latency_pwm_armed = 0;
+      }
+    #endif
   }
 
   // control the current segment's brightness by determining when to turn it on
@@ -0,0 +1,103 @@
+/* render.c
+ *
+ * layer compositor; see render.h
+ *
+ * the overlay's color is mixed over the base color with mul8_div255(), so with no overlay a
+ * segment's color is copied straight through and at full opacity it is exactly the overlay color.
+ * the overlay's effect on brightness is applied in true_segment_brightness_handler(). the composited
+ * color is passed through the blade's color calibration (see calib.h) on its way to render_color.
+ *
+ */
+
+#include <stdint.h>
+#include "blade_state.h"
+#include "frame.h"
+#include "fixed.h"
+#include "render.h"
+#include "calib.h"
+
+volatile uint8_t render_color[BLADE_SEGMENTS][RGB_SIZE];
+uint8_t overlay_level = 0;
+
+static uint8_t overlay_color[RGB_SIZE];
+static uint16_t overlay_hold = 0;         // milliseconds left at full opacity
+static uint16_t overlay_fade = 0;         // Q16 opacity while fading out; the high byte is overlay_level
+static uint16_t overlay_fade_rate = 0;    // overlay_fade lost per millisecond
+
+// set the overlay's opacity; brightness depends on it, so every segment must be recalculated
+static void overlay_set_level(uint8_t level) {
+  if (level != overlay_level) {
+    overlay_level = level;
+    segment_dirty = SEGMENT_DIRTY_ALL;
+  }
+}
+
+void overlay_start(const uint8_t *color, uint16_t hold, uint16_t settle) {
+  uint8_t c;
+
+  for (c=0;c<RGB_SIZE;c++) {
+    overlay_color[c] = color[c];
+  }
+  overlay_hold = hold;
+  overlay_fade = 0xFFFF;
+  overlay_fade_rate = (settle == 0) ? 0xFFFF : (0xFFFF / settle);
+  overlay_set_level(255);
+}
+
+void overlay_clear(void) {
+  overlay_hold = 0;
+  overlay_fade = 0;
+  overlay_set_level(0);
+}
+
+// advance the overlay's hold and fade by frame_dt
+static void overlay_step(void) {
+  uint8_t dt = frame_dt;
+  uint32_t loss;
+
+  if (overlay_level == 0 || dt == 0) {
+    return;
+  }
+
+  // use up the hold time first
+  if (overlay_hold > dt) {
+    overlay_hold -= dt;
+    return;
+  }
+  dt -= overlay_hold;
+  overlay_hold = 0;
+
+  // then fade out
+  loss = (uint32_t)overlay_fade_rate * dt;
+  if (loss >= overlay_fade) {
+    overlay_clear();
+  } else {
+    overlay_fade -= (uint16_t)loss;
+    overlay_set_level(overlay_fade >> 8);
+  }
+}
+
+void render_handler(void) {
+  uint8_t s, c, base, over;
+  uint8_t rgb[RGB_SIZE];
+
+  overlay_step();
+
+  for (s=0;s<BLADE_SEGMENTS;s++) {
+    for (c=0;c<RGB_SIZE;c++) {
+      base = segment_color[s][c];
+      if (overlay_level != 0) {
+        over = overlay_color[c];
+        if (over >= base) {
+          base += mul8_div255(over - base, overlay_level);
+        } else {
+          base -= mul8_div255(base - over, overlay_level);
+        }
+      }
+      rgb[c] = base;
+    }
+
+    // correct the composited color for this blade's LEDs
+    calib_apply(s, rgb, render_color[s]);
+  }
+}
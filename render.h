@@ -0,0 +1,41 @@
+/* render.h
+ *
+ * the blade is drawn from three layers, combined by render_handler() and true_segment_brightness_handler():
+ *
+ *   base layer      segment_color; the stock or dmode color, written by the set_*_color() functions
+ *   effect layer    segment_brightness; flicker, breathing, etc. multiplied with max_segment_brightness
+ *   overlay         a transient color (clash, flash) mixed over the other two layers by overlay_level
+ *
+ * an overlay never touches the layers beneath it, so nothing has to be backed up and restored around
+ * it, and effects keep running underneath while it is shown.
+ *
+ */ 
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GLOBAL: render_color[4][3] - the composited color of each segment; this is what pwm_handler() displays
+extern volatile uint8_t render_color[BLADE_SEGMENTS][RGB_SIZE];
+
+// GLOBAL: overlay_level - opacity of the overlay (0-255); 0 = no overlay. at 255 the blade shows the
+//         overlay color at full brightness
+extern uint8_t overlay_level;
+
+// show color over the whole blade at full opacity for hold milliseconds, then fade it out over settle milliseconds
+void overlay_start(const uint8_t *color, uint16_t hold, uint16_t settle);
+
+// remove the overlay immediately
+void overlay_clear(void);
+
+// advance the overlay and composite the layers into render_color; call once per loop pass
+void render_handler(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* RENDER_H_ */
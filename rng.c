@@ -0,0 +1,33 @@
+/* rng.c
+ *
+ * 16-bit xorshift generator using the (7, 9, 8) shift triple, which has a full period of 65535.
+ * see: http://www.retroprogramming.com/2017/07/xorshift-pseudorandom-numbers-in-z80.html
+ *
+ * shifts of 8 are byte moves on AVR, so a call is a handful of shifts and XORs.
+ *
+ */
+
+#include <stdint.h>
+#include "rng.h"
+
+static uint16_t rng_state = 1;
+
+void rng_seed(uint16_t seed) {
+  rng_state = seed ? seed : 0xACE1;
+}
+
+uint16_t rng16(void) {
+  uint16_t x = rng_state;
+
+  x ^= x << 7;
+  x ^= x >> 9;
+  x ^= x << 8;
+  rng_state = x;
+  return x;
+}
+
+// scale the next value into the range 0 to n-1: (r * n) / 65536. using all 16 bits keeps the
+// bias between outcomes below 0.4% for any n, where scaling the top 8 bits would bias by up to 50%
+uint8_t rng_range(uint8_t n) {
+  return (uint8_t)(((uint32_t)rng16() * n) >> 16);
+}
@@ -0,0 +1,31 @@
+/* rng.h
+ *
+ * a small 16-bit xorshift pseudo-random number generator for effect code. it's much cheaper
+ * than avr-libc's rand(), which uses a 32-bit multiply LCG, and rng_range() picks a value in
+ * a range using the hardware multiplier instead of a division.
+ *
+ */ 
+
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// seed the generator; call once at startup. a seed of 0 is replaced since xorshift can't leave 0
+void rng_seed(uint16_t seed);
+
+// return the next 16-bit pseudo-random value; never 0, period of 65535
+uint16_t rng16(void);
+
+// return a pseudo-random value from 0 to n-1 without dividing; returns 0 if n is 0
+uint8_t rng_range(uint8_t n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* RNG_H_ */
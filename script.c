@@ -0,0 +1,177 @@
+/* script.c
+ *
+ * effect bytecode interpreter; see script.h
+ *
+ * scripts are read straight out of EEPROM, which the ATtiny maps into the data address space,
+ * so no RAM is spent on a copy. interpreter state is 9 bytes.
+ *
+ */
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+#include "blade_state.h"
+#include "eeprom.h"
+#include "fixed.h"
+#include "rng.h"
+#include "fade.h"
+#include "hsv.h"
+#include "script.h"
+
+static uint8_t script_start = 0;    // offset of the selected script in the script area
+static uint8_t script_pc = 0;       // offset of the next instruction
+static uint16_t script_wait = 0;    // milliseconds left in the current WAIT
+static uint8_t script_sp = 0;       // number of open LOOPs
+static struct {
+  uint8_t pc;                       // offset of the first instruction in the loop
+  uint8_t count;                    // passes left; 0 = forever
+} script_loop[SCRIPT_LOOP_DEPTH];
+
+// read a byte of the script area; anything past its end reads as SCRIPT_OP_END
+static uint8_t script_byte(uint8_t offset) {
+  if (offset >= EEPROM_SCRIPT_LEN) {
+    return SCRIPT_OP_END;
+  }
+  return eeprom_read_byte((uint8_t *)(EEPROM_SCRIPT_ADDR + offset));
+}
+
+// length in bytes of an instruction, including the opcode; 0 if it ends the script
+static uint8_t script_op_len(uint8_t op) {
+  switch (op & 0xF0) {
+    case SCRIPT_OP_COLOR:       return 4;
+    case SCRIPT_OP_FADE:        return 5;
+    case SCRIPT_OP_RAND_HUE:    return 1;
+    case SCRIPT_OP_LEVEL:       return 2;
+    case SCRIPT_OP_RAND_LEVEL:  return 3;
+    case SCRIPT_OP_WAIT:        return 2;
+    case SCRIPT_OP_LOOP:        return 2;
+    case SCRIPT_OP_NEXT:        return 1;
+    default:                    return 0;
+  }
+}
+
+// go back to the start of the selected script
+static void script_restart(void) {
+  script_pc = script_start;
+  script_wait = 0;
+  script_sp = 0;
+}
+
+void script_select(uint8_t n) {
+  uint8_t offset = 0;
+  uint8_t len;
+
+  // skip over n scripts; each one ends at its first SCRIPT_OP_END
+  script_start = 0;
+  while (n != 0 && offset < EEPROM_SCRIPT_LEN) {
+    len = script_op_len(script_byte(offset));
+    if (len == 0) {
+      n--;
+      script_start = ++offset;
+    } else {
+      offset += len;
+    }
+  }
+
+  // there aren't that many scripts; run the first one
+  if (n != 0 || script_op_len(script_byte(script_start)) == 0) {
+    script_start = 0;
+  }
+  script_restart();
+}
+
+// apply a color to every segment in mask
+static void script_color(uint8_t mask, uint8_t red, uint8_t green, uint8_t blue, uint16_t time) {
+  uint8_t i;
+
+  for (i=0;i<BLADE_SEGMENTS;i++) {
+    if (mask & (1 << i)) {
+      fade_segment_color(i, q16_mul8(red, RED_ADJUST), green, blue, time);
+    }
+  }
+}
+
+void script_run(uint8_t dt) {
+  uint8_t budget = SCRIPT_BUDGET;
+  uint8_t op, mask, len, i, lo, hi, rgb[RGB_SIZE];
+
+  // finish any WAIT first. time left over once it ends is taken off the next WAIT, so a script keeps
+  // its timing when a WAIT ends part way through a frame; a WAIT the leftover time doesn't cover still
+  // ends the frame
+  if (script_wait > dt) {
+    script_wait -= dt;
+    return;
+  }
+  dt -= script_wait;
+  script_wait = 0;
+
+  while (budget-- != 0) {
+    op = script_byte(script_pc);
+    len = script_op_len(op);
+
+    // end of script (or a bad instruction); start over next frame
+    if (len == 0 || (uint16_t)script_pc + len > EEPROM_SCRIPT_LEN) {
+      script_restart();
+      return;
+    }
+
+    mask = op & 0x0F;
+    switch (op & 0xF0) {
+      case SCRIPT_OP_COLOR:
+        script_color(mask, script_byte(script_pc + 1), script_byte(script_pc + 2), script_byte(script_pc + 3), 0);
+        break;
+
+      case SCRIPT_OP_FADE:
+        script_color(mask, script_byte(script_pc + 1), script_byte(script_pc + 2), script_byte(script_pc + 3), (uint16_t)script_byte(script_pc + 4) * SCRIPT_TIME_UNIT);
+        break;
+
+      case SCRIPT_OP_RAND_HUE:
+        hsv_to_rgb(rng16(), 255, 255, rgb);
+        script_color(mask, rgb[RED_IDX], rgb[GRN_IDX], rgb[BLU_IDX], 0);
+        break;
+
+      case SCRIPT_OP_LEVEL:
+      case SCRIPT_OP_RAND_LEVEL:
+        lo = script_byte(script_pc + 1);
+        hi = (len == 3) ? script_byte(script_pc + 2) : lo;
+        for (i=0;i<BLADE_SEGMENTS;i++) {
+          if (mask & (1 << i)) {
+            segment_brightness[i] = (hi > lo) ? lo + (uint8_t)(((uint32_t)rng16() * ((uint16_t)(hi - lo) + 1)) >> 16) : lo;
+          }
+        }
+        segment_dirty |= mask;
+        break;
+
+      case SCRIPT_OP_WAIT:
+        script_wait = (uint16_t)script_byte(script_pc + 1) * SCRIPT_TIME_UNIT;
+        script_pc += len;
+        if (script_wait >= dt) {
+          script_wait -= dt;
+          return;
+        }
+        dt -= script_wait;
+        script_wait = 0;
+        continue;
+
+      case SCRIPT_OP_LOOP:
+        if (script_sp == SCRIPT_LOOP_DEPTH) {
+          script_restart();
+          return;
+        }
+        script_loop[script_sp].pc = script_pc + len;
+        script_loop[script_sp].count = script_byte(script_pc + 1);
+        script_sp++;
+        break;
+
+      case SCRIPT_OP_NEXT:
+        if (script_sp != 0) {
+          if (script_loop[script_sp - 1].count == 0 || --script_loop[script_sp - 1].count != 0) {
+            script_pc = script_loop[script_sp - 1].pc;
+            continue;
+          }
+          script_sp--;
+        }
+        break;
+    }
+    script_pc += len;
+  }
+}
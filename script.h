@@ -0,0 +1,58 @@
+/* script.h
+ *
+ * a tiny bytecode interpreter for blade effects stored in EEPROM, so new effects can be loaded
+ * through extended commands (DATA_EXT_TYPE_SCRIPT) instead of reflashing the blade.
+ *
+ * the script area holds one or more scripts back to back, each ending with SCRIPT_OP_END. the
+ * script display mode (DMODE_SCRIPT) runs script number blade.dsubmode. when a script ends it
+ * starts over. an instruction is one opcode byte followed by its operands; the low nibble of the
+ * opcode is a mask of the segments it applies to (bit 0 = segment 1 ... bit 3 = segment 4, 0x0F = all).
+ *
+ *   opcode                   operands                bytes   action
+ *   SCRIPT_OP_COLOR | mask   red green blue          4       set segment color
+ *   SCRIPT_OP_FADE  | mask   red green blue time     5       fade segment color over time * 10ms
+ *   SCRIPT_OP_RAND_HUE | mask                        1       set segments to one random fully saturated color
+ *   SCRIPT_OP_LEVEL | mask   level                   2       set segment brightness (0-255)
+ *   SCRIPT_OP_RAND_LEVEL | mask  low high            3       set each segment to its own random brightness from low to high
+ *   SCRIPT_OP_WAIT           time                    2       pause for time * 10ms
+ *   SCRIPT_OP_LOOP           count                   2       repeat the code up to the matching NEXT count times; 0 = forever
+ *   SCRIPT_OP_NEXT                                   1       end of a LOOP
+ *   SCRIPT_OP_END                                    1       end of the script; any undefined opcode also ends it
+ *
+ * the interpreter runs at most SCRIPT_BUDGET instructions per frame, so a script that never waits
+ * still can't stall the main loop.
+ *
+ */ 
+
+#ifndef SCRIPT_H_
+#define SCRIPT_H_
+
+#define SCRIPT_OP_END         0x00
+#define SCRIPT_OP_COLOR       0x10
+#define SCRIPT_OP_FADE        0x20
+#define SCRIPT_OP_RAND_HUE    0x30
+#define SCRIPT_OP_LEVEL       0x40
+#define SCRIPT_OP_RAND_LEVEL  0x50
+#define SCRIPT_OP_WAIT        0x60
+#define SCRIPT_OP_LOOP        0x70
+#define SCRIPT_OP_NEXT        0x80
+
+#define SCRIPT_BUDGET         8     // maximum instructions run per frame
+#define SCRIPT_LOOP_DEPTH     2     // how deeply LOOPs may nest
+#define SCRIPT_TIME_UNIT      10    // WAIT and FADE times are in units of this many milliseconds
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// start script number n (0 = the first) from the beginning; runs the first script if there is no script n
+void script_select(uint8_t n);
+
+// run the selected script for dt milliseconds worth of time
+void script_run(uint8_t dt);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* SCRIPT_H_ */
@@ -14,10 +14,11 @@
  */ 
 
 #include <avr/io.h>
-#include <string.h>
 #include "serial.h"
 
+#ifdef DEBUG_SERIAL_ENABLED
 char serial_buf[SERIAL_BUF_LEN];
+#endif
 
 void serial_setup( void ) {
 
@@ -41,9 +42,10 @@ void USART0_sendChar(char c) {
   USART0.TXDATAL = c;
 }
 
-void serial_sendString(char *str)
+// string literals are const and stay in flash, the same as the constant tables
+void serial_sendString(const char *str)
 {
-  for(size_t i = 0; i < strlen(str); i++)   {
-    USART0_sendChar(str[i]);
+  while (*str) {
+    USART0_sendChar(*str++);
   }
 }
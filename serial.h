@@ -18,11 +18,14 @@
 extern "C" {
 #endif
 
+// only allocated when serial debugging is enabled; all uses must be inside DEBUG_SERIAL_ENABLED blocks
+#ifdef DEBUG_SERIAL_ENABLED
 extern char serial_buf[SERIAL_BUF_LEN];
+#endif
 
 void serial_setup(void);
 void USART0_sendChar(char);
-void serial_sendString(char*);
+void serial_sendString(const char*);
 
 #ifdef __cplusplus
 } // extern "C"